@@ -0,0 +1,40 @@
+#include "pch.h"
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace Kore;
+
+namespace {
+	std::atomic<u64> allocations(0);
+	std::atomic<u64> allocatedBytes(0);
+}
+
+void* operator new(size_t size) {
+	++allocations;
+	allocatedBytes += size;
+	void* memory = malloc(size > 0 ? size : 1);
+	if (memory == nullptr) throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	free(memory);
+}
+
+u64 allocationCount() {
+	return allocations;
+}
+
+u64 allocatedByteCount() {
+	return allocatedBytes;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Every allocation of the process through operator new, the benchmarks report the ones per iteration.
+// The replaced operators live in their own translation unit so they are never inlined into callers.
+Kore::u64 allocationCount();
+Kore::u64 allocatedByteCount();
@@ -0,0 +1,397 @@
+#include "pch.h"
+#include "AllocationCounter.h"
+#include "Benchmarks.h"
+#include "JobSystem.h"
+#include "LightManager.h"
+#include "MappedFile.h"
+#include "MeshBuffer.h"
+#include "MipChain.h"
+#include "ObjLoader.h"
+#include "ParticleSystem.h"
+#include "ScratchArena.h"
+#include <Kore/Graphics1/Image.h>
+#include <Kore/Log.h>
+#include <Kore/System.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Runs the CPU side of the app without opening a window and writes the results as JSON,
+// run from the Deployment directory: KoreTestG3Benchmarks [--output benchmarks.json]
+
+using namespace Kore;
+
+namespace {
+	// Every benchmark runs for at least this long after a warm-up iteration
+	const double minSeconds = 0.5;
+	const int minIterations = 5;
+	const int maxIterations = 10000;
+
+	const int particleCounts[] = { 1000, 10000, 100000, 1000000 };
+	const int numParticleCounts = sizeof(particleCounts) / sizeof(particleCounts[0]);
+
+	// Scale of the scene meshes in TestG3
+	const float meshScale = 0.4f;
+
+	const int matrixFrames = 1000;
+
+	// Lights spread over a cube of lightVolume units, queried for objects spread the same way
+	const int lightCounts[] = { 100, 1000, 10000 };
+	const int numLightCounts = sizeof(lightCounts) / sizeof(lightCounts[0]);
+	const float lightVolume = 40.0f;
+	const int lightQueries = 1000;
+	const int selectedLightCount = 8;
+
+	// Stand-ins for a level's worth of large textures, a few distinct images repeated
+	const int syntheticTextureCount = 128;
+	const int syntheticTextureImages = 8;
+	const int syntheticTextureSize = 1024;
+
+	const char* defaultOutput = "benchmarks.json";
+
+	struct Result {
+		std::string name;
+		const char* unit; // of the throughput
+		double throughput; // at the median time
+		int iterations;
+		double p50; // seconds per iteration
+		double p95;
+		double p99;
+		double max;
+		double allocations; // per iteration
+		double allocatedBytes;
+	};
+
+	std::vector<Result> results;
+
+	// Nearest rank
+	double percentile(const std::vector<double>& sorted, double p) {
+		int rank = (int)std::ceil(p * sorted.size()) - 1;
+		return sorted[std::max(0, std::min((int)sorted.size() - 1, rank))];
+	}
+
+	// Calls iteration repeatedly, work is the amount of unit one call does
+	template<typename Iteration> void measure(const std::string& name, double work, const char* unit, Iteration iteration) {
+		iteration();
+
+		std::vector<double> times;
+		times.reserve(maxIterations);
+		const u64 allocationsBefore = allocationCount();
+		const u64 bytesBefore = allocatedByteCount();
+		const double start = System::time();
+		while ((int)times.size() < minIterations || (System::time() - start < minSeconds && (int)times.size() < maxIterations)) {
+			double iterationStart = System::time();
+			iteration();
+			times.push_back(System::time() - iterationStart);
+		}
+		const double iterations = (double)times.size();
+
+		Result result;
+		result.name = name;
+		result.unit = unit;
+		result.iterations = (int)times.size();
+		result.allocations = (allocationCount() - allocationsBefore) / iterations;
+		result.allocatedBytes = (allocatedByteCount() - bytesBefore) / iterations;
+		std::sort(times.begin(), times.end());
+		result.p50 = percentile(times, 0.5);
+		result.p95 = percentile(times, 0.95);
+		result.p99 = percentile(times, 0.99);
+		result.max = times.back();
+		result.throughput = result.p50 > 0.0 ? work / result.p50 : 0.0;
+		results.push_back(result);
+
+		log(Info, "%-46s %10.2f %-14s p50 %8.3f ms  p99 %8.3f ms  %8.1f allocations", name.c_str(), result.throughput, unit,
+			result.p50 * 1000.0, result.p99 * 1000.0, result.allocations);
+	}
+
+	bool benchmarkObjLoading() {
+		bool success = true;
+		for (int asset = 0; asset < numBenchmarkObjAssets; ++asset) {
+			const char* filename = benchmarkObjAssets[asset];
+			int size;
+			{
+				MappedFile file(filename);
+				if (file.data() == nullptr) {
+					log(Error, "Could not open %s", filename);
+					success = false;
+					continue;
+				}
+				size = file.size();
+			}
+			measure(std::string("loadObj ") + filename, size / (1024.0 * 1024.0), "MB/s", [filename] {
+				loadObj(filename);
+			});
+		}
+		return success;
+	}
+
+	// Parses into memory which is kept between iterations, so only the parse is measured
+	class MemorySink : public MeshSink {
+	public:
+		void begin(int numVertices, int numIndices, float*& targetVertices, int*& targetIndices) override {
+			vertices.resize(numVertices * 8);
+			indices.resize(numIndices);
+			targetVertices = vertices.data();
+			targetIndices = indices.data();
+		}
+
+		std::vector<float> vertices;
+		std::vector<int> indices;
+	};
+
+	// Parsing straight into the destination compared to loadObj followed by the copy into it
+	void benchmarkStreamedLoading() {
+		for (int asset = 0; asset < numBenchmarkObjAssets; ++asset) {
+			const char* filename = benchmarkObjAssets[asset];
+			int size;
+			{
+				MappedFile file(filename);
+				if (file.data() == nullptr) continue;
+				size = file.size();
+			}
+			MemorySink sink;
+			measure(std::string("loadObj streamed ") + filename, size / (1024.0 * 1024.0), "MB/s", [filename, &sink] {
+				loadObj(filename, sink, meshScale);
+			});
+			measure(std::string("loadObj and copy ") + filename, size / (1024.0 * 1024.0), "MB/s", [filename, &sink] {
+				Mesh mesh = loadObj(filename);
+				sink.vertices.resize(mesh.numVertices * 8);
+				sink.indices.resize(mesh.numFaces * 3);
+				copyMeshVertices(mesh, meshScale, sink.vertices.data());
+				memcpy(sink.indices.data(), mesh.indices, mesh.numFaces * 3 * sizeof(int));
+			});
+		}
+	}
+
+	// The vertex loop of createMeshBuffer, into memory instead of a vertex buffer
+	void benchmarkMeshCopies() {
+		for (int asset = 0; asset < numBenchmarkObjAssets; ++asset) {
+			const char* filename = benchmarkObjAssets[asset];
+			if (!MappedFile(filename).data()) continue;
+			Mesh mesh = loadObj(filename);
+			std::vector<float> vertices(mesh.numVertices * 8);
+			measure(std::string("copyMeshVertices ") + filename, vertices.size() * sizeof(float) / (1024.0 * 1024.0), "MB/s", [&mesh, &vertices] {
+				copyMeshVertices(mesh, meshScale, vertices.data());
+			});
+		}
+	}
+
+	// What decodeTexture does on a worker for every texture which is not baked
+	void decodeTexture(const char* filename) {
+		Graphics1::Image image(filename, true);
+		if (image.format != Graphics1::Image::RGBA32) return;
+		MipChain mipChain;
+		mipChain.build(image.data, image.width, image.height);
+	}
+
+	// One texture after the other, which only splits the large mip levels into tasks, compared to
+	// every texture as a task
+	bool benchmarkTextureDecoding() {
+		std::vector<const char*> filenames;
+		int size = 0;
+		for (int asset = 0; asset < numBenchmarkTextureAssets; ++asset) {
+			MappedFile file(benchmarkTextureAssets[asset]);
+			if (file.data() == nullptr) {
+				log(Error, "Could not open %s", benchmarkTextureAssets[asset]);
+				continue;
+			}
+			filenames.push_back(benchmarkTextureAssets[asset]);
+			size += file.size();
+		}
+		if (filenames.empty()) return false;
+
+		const int count = (int)filenames.size();
+		measure("Decode textures and mipmaps one at a time", size / (1024.0 * 1024.0), "MB/s", [&filenames, count] {
+			for (int i = 0; i < count; ++i) decodeTexture(filenames[i]);
+		});
+		measure("Decode textures and mipmaps as tasks", size / (1024.0 * 1024.0), "MB/s", [&filenames, count] {
+			parallelFor(count, 1, [&filenames](int begin, int end) {
+				for (int i = begin; i < end; ++i) decodeTexture(filenames[i]);
+			});
+		});
+		return (int)filenames.size() == numBenchmarkTextureAssets;
+	}
+
+	// Mip chains of many large textures, there are no encoded files of that size to decode
+	void benchmarkMipChains() {
+		std::vector<std::vector<u8>> images(syntheticTextureImages);
+		srand(1);
+		for (int image = 0; image < syntheticTextureImages; ++image) {
+			images[image].resize(syntheticTextureSize * syntheticTextureSize * 4);
+			for (size_t i = 0; i < images[image].size(); ++i) images[image][i] = (u8)rand();
+		}
+
+		std::vector<MipChain> mipChains(syntheticTextureCount);
+		const double megapixels = syntheticTextureCount * (double)syntheticTextureSize * syntheticTextureSize / 1e6;
+		char name[64];
+		sprintf(name, "MipChain %d x %dx%d one at a time", syntheticTextureCount, syntheticTextureSize, syntheticTextureSize);
+		measure(name, megapixels, "M texels/s", [&images, &mipChains] {
+			for (int i = 0; i < syntheticTextureCount; ++i) {
+				mipChains[i].build(images[i % syntheticTextureImages].data(), syntheticTextureSize, syntheticTextureSize);
+			}
+		});
+		sprintf(name, "MipChain %d x %dx%d as tasks", syntheticTextureCount, syntheticTextureSize, syntheticTextureSize);
+		measure(name, megapixels, "M texels/s", [&images, &mipChains] {
+			parallelFor(syntheticTextureCount, 1, [&images, &mipChains](int begin, int end) {
+				for (int i = begin; i < end; ++i) mipChains[i].build(images[i % syntheticTextureImages].data(), syntheticTextureSize, syntheticTextureSize);
+			});
+		});
+	}
+
+	float randomFloat(float low, float high) {
+		return low + (high - low) * rand() / RAND_MAX;
+	}
+
+	// Picking the lights of a draw with the grid of LightManager compared to looking at every light,
+	// both have to pick the same ones
+	bool benchmarkLightSelection() {
+		bool success = true;
+		for (int i = 0; i < numLightCounts; ++i) {
+			const int lightCount = lightCounts[i];
+			srand(1);
+			LightManager manager;
+			std::vector<float> positions(lightCount * 3);
+			std::vector<float> radii(lightCount);
+			std::vector<Light*> all(lightCount);
+			for (int light = 0; light < lightCount; ++light) {
+				for (int axis = 0; axis < 3; ++axis) positions[light * 3 + axis] = randomFloat(0.0f, lightVolume);
+				// A few lights reach over the whole volume
+				radii[light] = light % 50 == 0 ? lightVolume : randomFloat(0.5f, 3.0f);
+				all[light] = manager.addPointLight(vec3(positions[light * 3], positions[light * 3 + 1], positions[light * 3 + 2]), vec3(1, 1, 1), radii[light]);
+			}
+			std::vector<float> objects(lightQueries * 4);
+			for (int query = 0; query < lightQueries; ++query) {
+				for (int axis = 0; axis < 3; ++axis) objects[query * 4 + axis] = randomFloat(0.0f, lightVolume);
+				objects[query * 4 + 3] = randomFloat(0.2f, 1.5f);
+			}
+
+			std::vector<Light*> selected(lightQueries * selectedLightCount);
+			std::vector<int> counts(lightQueries);
+			char name[64];
+			sprintf(name, "LightManager::select %d lights", lightCount);
+			measure(name, lightQueries / 1e6, "M draws/s", [&] {
+				for (int query = 0; query < lightQueries; ++query) {
+					const float* object = &objects[query * 4];
+					counts[query] = manager.select(vec3(object[0], object[1], object[2]), object[3], 1, &selected[query * selectedLightCount], selectedLightCount);
+				}
+			});
+
+			// The same order as select: by influence, equal ones by when they were added
+			std::vector<Light*> reference(lightQueries * selectedLightCount);
+			std::vector<int> referenceCounts(lightQueries);
+			std::vector<std::pair<float, int>> influences;
+			sprintf(name, "Light scan %d lights", lightCount);
+			measure(name, lightQueries / 1e6, "M draws/s", [&] {
+				for (int query = 0; query < lightQueries; ++query) {
+					const float* object = &objects[query * 4];
+					influences.clear();
+					for (int light = 0; light < lightCount; ++light) {
+						float distanceSquared = 0;
+						for (int axis = 0; axis < 3; ++axis) {
+							float delta = positions[light * 3 + axis] - object[axis];
+							distanceSquared += delta * delta;
+						}
+						const float reach = object[3] + radii[light];
+						if (distanceSquared >= reach * reach) continue;
+						const float gap = std::max(0.0f, std::sqrt(distanceSquared) - object[3]);
+						influences.push_back(std::make_pair(-(1.0f - gap / radii[light]), light));
+					}
+					const int count = std::min((int)influences.size(), selectedLightCount);
+					std::partial_sort(influences.begin(), influences.begin() + count, influences.end());
+					for (int j = 0; j < count; ++j) reference[query * selectedLightCount + j] = all[influences[j].second];
+					referenceCounts[query] = count;
+				}
+			});
+
+			int mismatches = 0;
+			for (int query = 0; query < lightQueries; ++query) {
+				if (counts[query] != referenceCounts[query] || !std::equal(&selected[query * selectedLightCount],
+						&selected[query * selectedLightCount] + counts[query], &reference[query * selectedLightCount])) ++mismatches;
+			}
+			if (mismatches > 0) {
+				log(Error, "%d of %d light selections differ from the scan", mismatches, lightQueries);
+				success = false;
+			}
+		}
+		return success;
+	}
+
+	void benchmarkParticleSteps() {
+		for (int i = 0; i < numParticleCounts; ++i) {
+			ParticleSystem particles(particleCounts[i]);
+			char name[64];
+			sprintf(name, "ParticleSystem::simulate %d", particleCounts[i]);
+			measure(name, particleCounts[i] / 1e6, "M particles/s", [&particles] {
+				particles.simulate(particleTimeStep);
+			});
+		}
+	}
+
+	// The matrices onDrawFrame sets up for the scene geometry
+	void benchmarkMatrixSetup() {
+		const mat4 projection = mat4::Perspective(45.0f * 3.14159265f / 180.0f, 1280.0f / 768.0f, 0.1f, 100.0f);
+		const mat4 camera = mat4::Translation(0, 0.0f, -2.5f);
+		float sink = 0.0f;
+		measure("Matrix setup", matrixFrames / 1e6, "M frames/s", [&] {
+			for (int frame = 0; frame < matrixFrames; ++frame) {
+				mat4 world = mat4::RotationY(std::sin(frame * 0.01f) * 1.3f);
+				mat4 view = camera.Invert();
+				mat4 transform = projection * view * world;
+				sink += transform.get(0, 0);
+			}
+		});
+		// Keeps the loop from being optimized away
+		if (sink == 12345.0f) log(Info, "%f", sink);
+	}
+
+	bool writeResults(const char* filename, int threads) {
+		FILE* file = fopen(filename, "w");
+		if (file == nullptr) return false;
+		fprintf(file, "{\n  \"threads\": %d,\n", threads);
+		fprintf(file, "  \"memory\": {\"peak_mesh_bytes\": %d, \"mesh_bytes\": %d, \"peak_scratch_bytes\": %d, \"scratch_bytes\": %d},\n",
+			peakMeshBytes(), meshBytes(), (int)peakScratchArenaBytes(), (int)scratchArenaBytes());
+		fprintf(file, "  \"benchmarks\": [\n");
+		for (size_t i = 0; i < results.size(); ++i) {
+			const Result& result = results[i];
+			fprintf(file, "    {\"name\": \"%s\", \"iterations\": %d, \"throughput\": %.4f, \"unit\": \"%s\", "
+				"\"latency_ms\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}, \"allocations\": %.1f, \"allocated_bytes\": %.0f}%s\n",
+				result.name.c_str(), result.iterations, result.throughput, result.unit, result.p50 * 1000.0, result.p95 * 1000.0, result.p99 * 1000.0,
+				result.max * 1000.0, result.allocations, result.allocatedBytes, i + 1 < results.size() ? "," : "");
+		}
+		fprintf(file, "  ]\n}\n");
+		return fclose(file) == 0;
+	}
+}
+
+#ifdef KOREC
+extern "C"
+#endif
+int kore(int argc, char** argv) {
+	const char* output = defaultOutput;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "--output") == 0) output = argv[i + 1];
+	}
+
+	startJobs();
+	bool success = benchmarkObjLoading();
+	benchmarkMeshCopies();
+	benchmarkStreamedLoading();
+	success = benchmarkTextureDecoding() && success;
+	benchmarkMipChains();
+	success = benchmarkLightSelection() && success;
+	benchmarkParticleSteps();
+	benchmarkMatrixSetup();
+	const int threads = jobThreadCount() + 1;
+	stopJobs();
+
+	if (!writeResults(output, threads)) {
+		log(Error, "Could not write %s", output);
+		return 1;
+	}
+	log(Info, "Wrote %s", output);
+	return success ? 0 : 1;
+}
@@ -0,0 +1,15 @@
+// Headless benchmarks of the app's CPU code, they need no window and no GPU.
+// Built from this directory like the app, run from Deployment (see Sources/BenchmarkSuite.cpp).
+var project = new Project('KoreTestG3Benchmarks', __dirname);
+
+project.addFile('Sources/**');
+project.addFile('../Sources/**');
+project.addExclude('../Sources/TestG3.cpp');
+project.addIncludeDir('../Sources');
+project.setDebugDir('../Deployment');
+project.cpp11 = true;
+
+Project.createProject('../Kore', __dirname).then((subproject) => {
+	project.addSubProject(subproject);
+	resolve(project);
+});
@@ -0,0 +1,342 @@
+#include "pch.h"
+#include "AssetLoader.h"
+#include "JobSystem.h"
+#include "MeshBuffer.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshTiles.h"
+#include "MipChain.h"
+#include "ObjLoader.h"
+#include "Profiler.h"
+#include "TextureCache.h"
+#include <Kore/Graphics1/Image.h>
+#include <Kore/Log.h>
+#include <Kore/System.h>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace Kore;
+
+namespace {
+	enum AssetState {
+		AssetLoading,  // job queued or running
+		AssetDecoded,  // waiting for the render thread
+		AssetUploaded
+	};
+
+	struct Asset {
+		std::string filename;
+		AssetState state;
+
+		// Meshes
+		const Graphics4::VertexStructure* vertexStructure;
+		float scale;
+		bool optimize;
+		int tiles; // per side
+		Mesh mesh; // scale already applied
+		MeshTiles* meshTiles;
+		std::vector<MeshLod> lods;
+		MeshBuffer* meshBuffer;
+
+		// Textures: an up to date baked one, else the decoded image's mip chain
+		// or, for formats other than RGBA32, the image itself
+		Graphics1::Image* image;
+		BakedTexture* bakedTexture;
+		MipChain* mipChain;
+		Graphics3::Texture* texture;
+	};
+
+	// Indexed by handle, taken assets are freed and their handles reused
+	std::vector<Asset*> assets;
+	std::vector<AssetHandle> freeHandles;
+	std::deque<Asset*> decoded;
+	std::mutex assetMutex;
+	int requested = 0;
+	int uploaded = 0;
+
+	Asset* createAsset(const char* filename) {
+		Asset* asset = new Asset;
+		asset->filename = filename;
+		asset->state = AssetLoading;
+		asset->vertexStructure = nullptr;
+		asset->scale = 1.0f;
+		asset->optimize = false;
+		asset->tiles = 0;
+		asset->meshTiles = nullptr;
+		asset->meshBuffer = nullptr;
+		asset->image = nullptr;
+		asset->bakedTexture = nullptr;
+		asset->mipChain = nullptr;
+		asset->texture = nullptr;
+		return asset;
+	}
+
+	AssetHandle addAsset(Asset* asset) {
+		std::lock_guard<std::mutex> lock(assetMutex);
+		++requested;
+		if (!freeHandles.empty()) {
+			AssetHandle handle = freeHandles.back();
+			freeHandles.pop_back();
+			assets[handle] = asset;
+			return handle;
+		}
+		assets.push_back(asset);
+		return (AssetHandle)assets.size() - 1;
+	}
+
+	// Once the result was taken, only the emptied entry is left
+	void releaseAsset(AssetHandle handle) {
+		std::lock_guard<std::mutex> lock(assetMutex);
+		delete assets[handle];
+		assets[handle] = nullptr;
+		freeHandles.push_back(handle);
+	}
+
+	void finishDecoding(Asset* asset) {
+		std::lock_guard<std::mutex> lock(assetMutex);
+		asset->state = AssetDecoded;
+		decoded.push_back(asset);
+	}
+
+	Asset* findAsset(AssetHandle handle) {
+		std::lock_guard<std::mutex> lock(assetMutex);
+		return handle >= 0 && handle < (int)assets.size() ? assets[handle] : nullptr;
+	}
+
+	Mesh loadBakedMesh(const BakedMesh& baked) {
+		Mesh mesh(baked.numVertices(), baked.numIndices() / 3);
+		baked.copyVertices(mesh.vertices);
+		baked.copyIndices(mesh.indices);
+		return mesh;
+	}
+
+	// Worker thread: reorders the mesh's triangles, so it has to run before anything copies them
+	void tileMesh(Asset* asset) {
+		if (asset->tiles <= 0) return;
+		PROFILE_ZONE("Tile mesh");
+		asset->meshTiles = new MeshTiles(asset->mesh, asset->tiles);
+	}
+
+	// Worker thread: the levels of detail are built from the scaled mesh so their errors are in its units
+	void simplifyMesh(Asset* asset) {
+		PROFILE_ZONE("Simplify mesh");
+		double start = System::time();
+		buildMeshLods(asset->mesh, maxMeshLods, asset->lods);
+		if (asset->lods.empty()) return;
+
+		std::string levels;
+		char level[64];
+		for (size_t i = 0; i < asset->lods.size(); ++i) {
+			sprintf(level, " %d (error %.4f)", (int)asset->lods[i].indices.size() / 3, asset->lods[i].error);
+			levels += level;
+		}
+		Kore::log(Kore::Info, "Simplified %s in %.2f ms: %d triangles ->%s", asset->filename.c_str(), (System::time() - start) * 1000.0,
+			asset->mesh.numFaces, levels.c_str());
+	}
+
+	// Worker thread: prefers the baked mesh if it is up to date, else parses and optimizes the OBJ
+	void decodeMesh(Asset* asset) {
+		PROFILE_ZONE("Decode mesh");
+		const char* filename = asset->filename.c_str();
+		{
+			BakedMesh baked(bakedMeshFilename(asset->filename).c_str(), filename, asset->scale, asset->optimize);
+			if (baked.valid()) {
+				asset->mesh = loadBakedMesh(baked);
+				// The levels only reference vertices, so tiling the full index list leaves them valid
+				baked.copyLods(asset->lods);
+				tileMesh(asset);
+				finishDecoding(asset);
+				return;
+			}
+		}
+
+		ObjLoadStats stats;
+		asset->mesh = loadObj(filename, asset->scale, &stats);
+		Mesh& mesh = asset->mesh;
+		Kore::log(Kore::Info, "Loaded %s: %d bytes, %d lines in %.2f ms on %d threads (%.1f MB/s, %.0f lines/s), %d positions welded into %d vertices",
+			filename, stats.bytes, stats.lines, stats.seconds * 1000.0, stats.threads, stats.bytesPerSecond() / (1024.0 * 1024.0), stats.linesPerSecond(),
+			stats.positions, mesh.numVertices);
+		if (asset->optimize) {
+			MeshOptimizationStats optimization;
+			optimizeMesh(&mesh, &optimization);
+			Kore::log(Kore::Info, "Optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", filename,
+				optimization.acmrBefore, optimization.acmrAfter, optimization.atvrBefore, optimization.atvrAfter);
+		}
+
+		tileMesh(asset);
+		simplifyMesh(asset);
+		finishDecoding(asset);
+	}
+
+	// Worker thread: a baked texture only needs to be mapped, else the image is decoded and filtered
+	void decodeTexture(Asset* asset) {
+		PROFILE_ZONE("Decode texture");
+		BakedTexture* baked = new BakedTexture(bakedTextureFilename(asset->filename).c_str(), asset->filename.c_str());
+		if (baked->valid()) {
+			asset->bakedTexture = baked;
+			finishDecoding(asset);
+			return;
+		}
+		delete baked;
+
+		asset->image = new Graphics1::Image(asset->filename.c_str(), true);
+		if (asset->image->format == Graphics1::Image::RGBA32) {
+			PROFILE_ZONE("Build mipmaps");
+			asset->mipChain = new MipChain;
+			asset->mipChain->build(asset->image->data, asset->image->width, asset->image->height);
+			delete asset->image;
+			asset->image = nullptr;
+		}
+		finishDecoding(asset);
+	}
+
+	void uploadMesh(Asset* asset) {
+		PROFILE_ZONE("Upload mesh");
+		asset->meshBuffer = createMeshBuffer(asset->mesh, *asset->vertexStructure);
+		if (!asset->lods.empty()) addMeshLods(asset->meshBuffer, asset->lods.data(), (int)asset->lods.size());
+		std::vector<MeshLod>().swap(asset->lods);
+		asset->meshBuffer->tiles = asset->meshTiles;
+		asset->meshTiles = nullptr;
+		asset->mesh = Mesh();
+	}
+
+	void copyToTexture(Graphics3::Texture* texture, const u8* source, int rowSize, int height) {
+		u8* target = texture->lock();
+		for (int y = 0; y < height; ++y) {
+			memcpy(target + y * texture->stride(), source + y * rowSize, rowSize);
+		}
+		texture->unlock();
+	}
+
+	// Uploads the RGBA32 levels of a BakedTexture or MipChain as they are
+	template<typename Levels>
+	Graphics3::Texture* uploadLevels(const Levels& levels) {
+		Graphics3::Texture* texture = new Graphics3::Texture(levels.width(0), levels.height(0), Graphics1::Image::RGBA32, false);
+		copyToTexture(texture, levels.levelData(0), levels.width(0) * 4, levels.height(0));
+		for (int level = 1; level < levels.levels(); ++level) {
+			Graphics3::Texture mipmap(levels.width(level), levels.height(level), Graphics1::Image::RGBA32, true);
+			copyToTexture(&mipmap, levels.levelData(level), levels.width(level) * 4, levels.height(level));
+			texture->setMipmap(&mipmap, level);
+		}
+		return texture;
+	}
+
+	void uploadTexture(Asset* asset) {
+		PROFILE_ZONE("Upload texture");
+		if (asset->bakedTexture != nullptr) {
+			asset->texture = uploadLevels(*asset->bakedTexture);
+			delete asset->bakedTexture;
+			asset->bakedTexture = nullptr;
+			return;
+		}
+		if (asset->mipChain != nullptr) {
+			asset->texture = uploadLevels(*asset->mipChain);
+			delete asset->mipChain;
+			asset->mipChain = nullptr;
+			return;
+		}
+
+		Graphics1::Image* image = asset->image;
+		Graphics3::Texture* texture = new Graphics3::Texture(image->width, image->height, image->format, false);
+		copyToTexture(texture, image->data, image->width * Graphics1::Image::sizeOf(image->format), image->height);
+		texture->generateMipmaps(0);
+		asset->texture = texture;
+		delete image;
+		asset->image = nullptr;
+	}
+}
+
+AssetHandle loadMeshAsync(const char* filename, const Graphics4::VertexStructure& vertexStructure, float scale, bool optimize, int tiles) {
+	Asset* asset = createAsset(filename);
+	asset->vertexStructure = &vertexStructure;
+	asset->scale = scale;
+	asset->optimize = optimize;
+	asset->tiles = tiles;
+	AssetHandle handle = addAsset(asset);
+	submitJob([asset] { decodeMesh(asset); });
+	return handle;
+}
+
+AssetHandle loadTextureAsync(const char* filename) {
+	Asset* asset = createAsset(filename);
+	AssetHandle handle = addAsset(asset);
+	submitJob([asset] { decodeTexture(asset); });
+	return handle;
+}
+
+int finishAssetUploads(double budgetSeconds) {
+	double startTime = System::time();
+	int count = 0;
+	do {
+		Asset* asset;
+		{
+			std::lock_guard<std::mutex> lock(assetMutex);
+			if (decoded.empty()) break;
+			asset = decoded.front();
+			decoded.pop_front();
+		}
+
+		if (asset->vertexStructure != nullptr) uploadMesh(asset);
+		else uploadTexture(asset);
+
+		std::lock_guard<std::mutex> lock(assetMutex);
+		asset->state = AssetUploaded;
+		++uploaded;
+		++count;
+	} while (System::time() - startTime < budgetSeconds);
+	return count;
+}
+
+bool isAssetReady(AssetHandle handle) {
+	Asset* asset = findAsset(handle);
+	std::lock_guard<std::mutex> lock(assetMutex);
+	return asset != nullptr && asset->state == AssetUploaded;
+}
+
+float assetLoadingProgress() {
+	std::lock_guard<std::mutex> lock(assetMutex);
+	return requested == 0 ? 1.0f : (float)uploaded / requested;
+}
+
+MeshBuffer* takeLoadedMesh(AssetHandle handle) {
+	if (!isAssetReady(handle)) return nullptr;
+	Asset* asset = findAsset(handle);
+	MeshBuffer* meshBuffer = asset->meshBuffer;
+	asset->meshBuffer = nullptr;
+	releaseAsset(handle);
+	return meshBuffer;
+}
+
+Graphics3::Texture* takeLoadedTexture(AssetHandle handle) {
+	if (!isAssetReady(handle)) return nullptr;
+	Asset* asset = findAsset(handle);
+	Graphics3::Texture* texture = asset->texture;
+	asset->texture = nullptr;
+	releaseAsset(handle);
+	return texture;
+}
+
+void shutdownAssetLoader() {
+	std::lock_guard<std::mutex> lock(assetMutex);
+	for (size_t i = 0; i < assets.size(); ++i) {
+		Asset* asset = assets[i];
+		if (asset == nullptr) continue;
+		delete asset->meshTiles;
+		delete asset->meshBuffer;
+		delete asset->image;
+		delete asset->bakedTexture;
+		delete asset->mipChain;
+		delete asset->texture;
+		delete asset;
+	}
+	assets.clear();
+	freeHandles.clear();
+	decoded.clear();
+	requested = 0;
+	uploaded = 0;
+}
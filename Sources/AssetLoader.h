@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Kore/Graphics3/Graphics.h>
+
+struct MeshBuffer;
+
+// Loads meshes and textures in the background. Reading, parsing, optimizing and decoding
+// run as jobs (see JobSystem.h), the buffers and textures are created on the render thread
+// by finishAssetUploads, a few per frame.
+typedef int AssetHandle;
+
+// vertexStructure has to stay alive until the mesh is uploaded. With tiles > 0 the triangles are
+// sorted into tiles x tiles tiles which can be culled one by one, see MeshTiles.h.
+AssetHandle loadMeshAsync(const char* filename, const Kore::Graphics4::VertexStructure& vertexStructure, float scale = 1.0f, bool optimize = true, int tiles = 0);
+AssetHandle loadTextureAsync(const char* filename);
+
+// Render thread: uploads decoded assets until budgetSeconds are used up, at least one per call.
+// Returns the number of assets uploaded.
+int finishAssetUploads(double budgetSeconds);
+
+bool isAssetReady(AssetHandle handle);
+
+// Uploaded assets of all requested so far, 0 to 1
+float assetLoadingProgress();
+
+// Hand the uploaded asset over to the caller, nullptr while it is not ready. Once it was taken
+// the handle is no longer valid, a later load may get it again.
+MeshBuffer* takeLoadedMesh(AssetHandle handle);
+Kore::Graphics3::Texture* takeLoadedTexture(AssetHandle handle);
+
+// Frees everything which was not taken, call after stopJobs
+void shutdownAssetLoader();
@@ -0,0 +1,226 @@
+#include "pch.h"
+#include "Benchmarks.h"
+#include "MappedFile.h"
+#include "JobSystem.h"
+#include "NumberParser.h"
+#include "ParticleSystem.h"
+#include "RadixSort.h"
+#include <Kore/Log.h>
+#include <Kore/System.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace Kore;
+
+const char* const benchmarkObjAssets[] = {
+	"Text_FixedFunctionOpenGL.obj",
+	"UnderTessellatedCube.obj",
+	"TessellatedCube.obj",
+	"TessellatedCube_Bumped.obj",
+	"TessellatedCube_Bumped2.obj",
+	"Terrain.obj",
+	"TessellatedPlane.obj",
+	"ParticleQuad.obj",
+};
+const int numBenchmarkObjAssets = sizeof(benchmarkObjAssets) / sizeof(benchmarkObjAssets[0]);
+
+const char* const benchmarkTextureAssets[] = {
+	"SeriousGamesTexture.png",
+	"SphereMap1.jpg",
+	"Grass.jpg",
+	"Metal.jpg",
+	"SpriteAlpha.png",
+};
+const int numBenchmarkTextureAssets = sizeof(benchmarkTextureAssets) / sizeof(benchmarkTextureAssets[0]);
+
+namespace {
+	const int numberRepetitions = 20;
+
+	const int benchmarkParticleCount = 1000000;
+	const int benchmarkParticleFrames = 120;
+	const float frameBudget = 1.0f / 60.0f;
+
+	const int sortParticleCount = 100000;
+	const int sortRepetitions = 100;
+	const double sortBudget = 0.001;
+
+	// The particle layout ParticleSystem replaced, for comparison
+	struct ReferenceParticle {
+		float position[3];
+		float velocity[3];
+		float time;
+	};
+
+	void launchReference(ReferenceParticle& particle) {
+		particle.time = 0;
+		particle.position[0] = particle.position[1] = particle.position[2] = 0;
+		particle.velocity[0] = 0.6f * rand() / RAND_MAX - 0.3f;
+		particle.velocity[1] = 1.3f;
+		particle.velocity[2] = 0.6f * rand() / RAND_MAX - 0.3f;
+	}
+
+	void simulateReference(ReferenceParticle& particle, float deltaTime) {
+		particle.time += deltaTime;
+		particle.velocity[1] += -9.81f * 0.1f * deltaTime;
+		for (int i = 0; i < 3; ++i) particle.position[i] += particle.velocity[i] * deltaTime;
+		if (particle.position[1] < -2.0f) launchReference(particle);
+	}
+
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	// Collects the zero terminated numbers of all v/vt/vn lines
+	void collectNumbers(const char* data, int size, std::string& text, std::vector<int>& offsets) {
+		const char* end = data + size;
+		const char* line = data;
+		while (line < end) {
+			const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+			if (lineEnd == nullptr) lineEnd = end;
+			if (lineEnd - line > 2 && line[0] == 'v' && (line[1] == ' ' || line[1] == 't' || line[1] == 'n')) {
+				const char* p = line + 2;
+				while (p < lineEnd) {
+					while (p < lineEnd && isSpace(*p)) ++p;
+					const char* token = p;
+					while (p < lineEnd && !isSpace(*p)) ++p;
+					if (p > token) {
+						offsets.push_back((int)text.size());
+						text.append(token, p);
+						text.push_back(0);
+					}
+				}
+			}
+			line = lineEnd + 1;
+		}
+	}
+}
+
+int benchmarkNumberParsing() {
+	int mismatches = 0;
+	double totalFast = 0, totalStrtod = 0;
+	int totalNumbers = 0;
+
+	for (int asset = 0; asset < numBenchmarkObjAssets; ++asset) {
+		std::string text;
+		std::vector<int> offsets;
+		{
+			MappedFile file(benchmarkObjAssets[asset]);
+			if (file.data() == nullptr) {
+				log(Error, "Could not open %s", benchmarkObjAssets[asset]);
+				return 1;
+			}
+			collectNumbers(file.data(), file.size(), text, offsets);
+		}
+		if (offsets.empty()) continue;
+
+		const char* numbers = text.c_str();
+		const int count = (int)offsets.size();
+		std::vector<float> fast(count), reference(count);
+
+		double start = System::time();
+		for (int repetition = 0; repetition < numberRepetitions; ++repetition) {
+			for (int i = 0; i < count; ++i) {
+				// numbers are stored back to back, each one followed by its terminator
+				const char* number = numbers + offsets[i];
+				const char* numberEnd = numbers + (i + 1 < count ? offsets[i + 1] : (int)text.size()) - 1;
+				parseFloat(number, numberEnd, fast[i]);
+			}
+		}
+		double fastTime = System::time() - start;
+
+		start = System::time();
+		for (int repetition = 0; repetition < numberRepetitions; ++repetition) {
+			for (int i = 0; i < count; ++i) {
+				reference[i] = (float)strtod(numbers + offsets[i], nullptr);
+			}
+		}
+		double strtodTime = System::time() - start;
+
+		for (int i = 0; i < count; ++i) {
+			if (memcmp(&fast[i], &reference[i], sizeof(float)) != 0) ++mismatches;
+		}
+
+		double parsed = (double)count * numberRepetitions;
+		log(Info, "%s: %d numbers, parseFloat %.1f ns/number, strtod %.1f ns/number (%.2fx)", benchmarkObjAssets[asset], count,
+			fastTime * 1e9 / parsed, strtodTime * 1e9 / parsed, fastTime > 0 ? strtodTime / fastTime : 0.0);
+
+		totalFast += fastTime;
+		totalStrtod += strtodTime;
+		totalNumbers += count;
+	}
+
+	double parsed = (double)totalNumbers * numberRepetitions;
+	log(Info, "Total: %d numbers, parseFloat %.1f ns/number, strtod %.1f ns/number, %d results differ from strtod", totalNumbers,
+		totalFast * 1e9 / parsed, totalStrtod * 1e9 / parsed, mismatches);
+
+	return mismatches == 0 ? 0 : 1;
+}
+
+int benchmarkParticles() {
+	const float deltaTime = 1.0f / 60.0f;
+
+	startJobs();
+	double start = System::time();
+	ParticleSystem particles(benchmarkParticleCount);
+	double creationTime = System::time() - start;
+	start = System::time();
+	for (int frame = 0; frame < benchmarkParticleFrames; ++frame) particles.simulate(deltaTime);
+	double soaTime = (System::time() - start) / benchmarkParticleFrames;
+	int threads = jobThreadCount() + 1;
+	stopJobs();
+
+	std::vector<ReferenceParticle> reference(benchmarkParticleCount);
+	for (size_t i = 0; i < reference.size(); ++i) launchReference(reference[i]);
+	start = System::time();
+	for (int frame = 0; frame < benchmarkParticleFrames; ++frame) {
+		for (size_t i = 0; i < reference.size(); ++i) simulateReference(reference[i], deltaTime);
+	}
+	double aosTime = (System::time() - start) / benchmarkParticleFrames;
+
+	log(Info, "%d particles: ParticleSystem %.2f ms/frame on %d threads (%.0f M particles/s), one struct per particle %.2f ms/frame (%.0f M particles/s), %.2fx",
+		benchmarkParticleCount, soaTime * 1000.0, threads, benchmarkParticleCount / soaTime / 1e6, aosTime * 1000.0, benchmarkParticleCount / aosTime / 1e6,
+		soaTime > 0 ? aosTime / soaTime : 0.0);
+	log(Info, "Creating them took %.2f ms", creationTime * 1000.0);
+	log(Info, soaTime <= frameBudget ? "Fits into a 60 Hz frame" : "Does not fit into a 60 Hz frame");
+
+	return soaTime <= frameBudget ? 0 : 1;
+}
+
+int benchmarkParticleSorting() {
+	startJobs();
+
+	// Depths along the view direction of particles in flight
+	ParticleSystem particles(sortParticleCount);
+	std::vector<float> depths(particles.positionsZ(), particles.positionsZ() + sortParticleCount);
+	for (int i = 0; i < sortParticleCount; ++i) depths[i] -= 2.5f + 0.1f * particles.positionsY()[i];
+
+	RadixSorter sorter;
+	const int* order = sorter.sort(depths.data(), sortParticleCount);
+	double start = System::time();
+	for (int repetition = 0; repetition < sortRepetitions; ++repetition) order = sorter.sort(depths.data(), sortParticleCount);
+	double radixTime = (System::time() - start) / sortRepetitions;
+	int threads = jobThreadCount() + 1;
+	stopJobs();
+
+	std::vector<int> reference(sortParticleCount);
+	start = System::time();
+	for (int repetition = 0; repetition < sortRepetitions; ++repetition) {
+		for (int i = 0; i < sortParticleCount; ++i) reference[i] = i;
+		std::stable_sort(reference.begin(), reference.end(), [&depths](int a, int b) { return depths[a] < depths[b]; });
+	}
+	double referenceTime = (System::time() - start) / sortRepetitions;
+
+	int mismatches = 0;
+	for (int i = 0; i < sortParticleCount; ++i) {
+		if (order[i] != reference[i]) ++mismatches;
+	}
+
+	log(Info, "%d particles: radix sort %.3f ms on %d threads, std::stable_sort %.3f ms (%.2fx), %d positions differ", sortParticleCount,
+		radixTime * 1000.0, threads, referenceTime * 1000.0, radixTime > 0 ? referenceTime / radixTime : 0.0, mismatches);
+	log(Info, radixTime <= sortBudget ? "Within the 1 ms budget" : "Over the 1 ms budget");
+
+	return mismatches == 0 && radixTime <= sortBudget ? 0 : 1;
+}
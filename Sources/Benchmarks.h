@@ -0,0 +1,20 @@
+#pragma once
+
+// Command line benchmarks, they log their results and return a process exit code
+
+// The OBJ files in Deployment
+extern const char* const benchmarkObjAssets[];
+extern const int numBenchmarkObjAssets;
+
+// The textures in Deployment
+extern const char* const benchmarkTextureAssets[];
+extern const int numBenchmarkTextureAssets;
+
+// Parses every number of the Deployment OBJ files with parseFloat and with strtod
+int benchmarkNumberParsing();
+
+// Simulates a million particles with ParticleSystem and with one struct per particle
+int benchmarkParticles();
+
+// Sorts the view depths of 100k particles with RadixSorter and with std::stable_sort
+int benchmarkParticleSorting();
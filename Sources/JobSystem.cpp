@@ -0,0 +1,231 @@
+#include "pch.h"
+#include "JobSystem.h"
+#include <Kore/System.h>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+using namespace Kore;
+
+struct Task {
+	Job job;
+	JobGroup* group;
+	const char* name;
+};
+
+namespace {
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<Task*> tasks;
+	};
+
+	std::vector<std::thread> workers;
+
+	// Queue 0 is shared by all threads which are not workers, worker i owns queue i
+	std::deque<TaskQueue> taskQueues(1);
+	std::atomic<int> queuedTasks(0);
+	thread_local int threadIndex = 0;
+
+	// Background jobs, also guards sleeping workers
+	std::deque<Job> jobs;
+	std::mutex jobMutex;
+	std::condition_variable workAvailable;
+	bool stopping = false;
+
+	std::vector<TaskTiming> timings;
+	std::mutex timingMutex;
+
+	void wakeWorker() {
+		{
+			std::lock_guard<std::mutex> lock(jobMutex);
+		}
+		workAvailable.notify_one();
+	}
+
+	void pushTask(Task* task) {
+		int index = threadIndex < (int)taskQueues.size() ? threadIndex : 0;
+		TaskQueue& queue = taskQueues[index];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back(task);
+		}
+		++queuedTasks;
+		wakeWorker();
+	}
+
+	// Newest task of the thread's own queue, else the oldest one of another queue
+	Task* findTask() {
+		if (queuedTasks == 0) return nullptr;
+		const int count = (int)taskQueues.size();
+		const int own = threadIndex < count ? threadIndex : 0;
+		{
+			TaskQueue& queue = taskQueues[own];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty()) {
+				Task* task = queue.tasks.back();
+				queue.tasks.pop_back();
+				--queuedTasks;
+				return task;
+			}
+		}
+		for (int i = 1; i < count; ++i) {
+			TaskQueue& queue = taskQueues[(own + i) % count];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (!queue.tasks.empty()) {
+				Task* task = queue.tasks.front();
+				queue.tasks.pop_front();
+				--queuedTasks;
+				return task;
+			}
+		}
+		return nullptr;
+	}
+
+	// Starts the tasks depending on the group once its last task is done. The group is not
+	// touched after the mutex is released, a waiting thread may destroy it right away.
+	void finishTask(Task* task) {
+		JobGroup* group = task->group;
+		delete task;
+
+		std::vector<Task*> continuations;
+		{
+			std::lock_guard<std::mutex> lock(group->mutex);
+			if (--group->pending == 0) continuations.swap(group->continuations);
+		}
+		for (size_t i = 0; i < continuations.size(); ++i) pushTask(continuations[i]);
+	}
+
+	void execute(Task* task) {
+		if (task->name != nullptr) {
+			TaskTiming timing;
+			timing.name = task->name;
+			timing.thread = threadIndex;
+			timing.start = System::time();
+			task->job();
+			timing.end = System::time();
+			std::lock_guard<std::mutex> lock(timingMutex);
+			timings.push_back(timing);
+		}
+		else {
+			task->job();
+		}
+		finishTask(task);
+	}
+
+	void work(int index) {
+		threadIndex = index;
+		for (;;) {
+			Task* task = findTask();
+			if (task != nullptr) {
+				execute(task);
+				continue;
+			}
+
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(jobMutex);
+				workAvailable.wait(lock, [] { return stopping || !jobs.empty() || queuedTasks > 0; });
+				if (stopping) return;
+				if (jobs.empty()) continue;
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+}
+
+JobGroup::~JobGroup() {
+	waitForTasks(*this);
+}
+
+void startJobs(int threads) {
+	if (!workers.empty()) return;
+	if (threads <= 0) threads = (int)std::thread::hardware_concurrency() - 1;
+	if (threads < 1) threads = 1;
+	stopping = false;
+	taskQueues.resize(threads + 1);
+	for (int i = 0; i < threads; ++i) workers.push_back(std::thread(work, i + 1));
+}
+
+void stopJobs() {
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+		jobs.clear();
+	}
+	workAvailable.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) workers[i].join();
+	workers.clear();
+
+	// Tasks still queued finish here, so their groups and continuations complete and nobody
+	// waiting for them afterwards waits forever
+	for (Task* task = findTask(); task != nullptr; task = findTask()) execute(task);
+	taskQueues.resize(1);
+}
+
+void submitJob(const Job& job) {
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobs.push_back(job);
+	}
+	workAvailable.notify_one();
+}
+
+int jobThreadCount() {
+	return (int)workers.size();
+}
+
+void runTask(const Job& job, JobGroup& group, const char* name) {
+	Task* task = new Task;
+	task->job = job;
+	task->group = &group;
+	task->name = name;
+	++group.pending;
+	pushTask(task);
+}
+
+void runTaskAfter(JobGroup& dependency, const Job& job, JobGroup& group, const char* name) {
+	Task* task = new Task;
+	task->job = job;
+	task->group = &group;
+	task->name = name;
+	++group.pending;
+	{
+		std::lock_guard<std::mutex> lock(dependency.mutex);
+		if (dependency.pending > 0) {
+			dependency.continuations.push_back(task);
+			return;
+		}
+	}
+	pushTask(task);
+}
+
+void waitForTasks(JobGroup& group) {
+	while (group.pending > 0) {
+		Task* task = findTask();
+		if (task != nullptr) execute(task);
+		else std::this_thread::yield();
+	}
+	// The last task may still be unlocking the group
+	std::lock_guard<std::mutex> lock(group.mutex);
+}
+
+void parallelFor(int count, int chunkSize, const std::function<void(int, int)>& function, const char* name) {
+	if (count <= chunkSize || workers.empty()) {
+		for (int begin = 0; begin < count; begin += chunkSize) function(begin, begin + chunkSize < count ? begin + chunkSize : count);
+		return;
+	}
+	JobGroup group;
+	for (int begin = 0; begin < count; begin += chunkSize) {
+		int end = begin + chunkSize < count ? begin + chunkSize : count;
+		runTask([&function, begin, end] { function(begin, end); }, group, name);
+	}
+	waitForTasks(group);
+}
+
+void takeTaskTimings(std::vector<TaskTiming>& target) {
+	std::lock_guard<std::mutex> lock(timingMutex);
+	target.insert(target.end(), timings.begin(), timings.end());
+	timings.clear();
+}
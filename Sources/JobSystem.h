@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Worker threads for two kinds of work:
+// - Background jobs, long running CPU work such as loading assets which must not stall the
+//   render thread. They run in the order they were submitted, on whichever worker is free.
+// - Tasks, short pieces of per-frame work. Every thread has its own deque of tasks, takes its
+//   newest task first and steals the oldest ones of other threads when it runs dry. A thread
+//   waiting for tasks runs tasks itself meanwhile (but no background jobs), so they also
+//   complete when no workers were started.
+typedef std::function<void()> Job;
+
+// threads = 0 uses one worker per hardware thread but the render thread, at least one
+void startJobs(int threads = 0);
+
+// Jobs which have not started yet are dropped, running ones are waited for. Queued tasks are
+// run by the calling thread so their groups still finish.
+void stopJobs();
+
+void submitJob(const Job& job);
+
+int jobThreadCount();
+
+struct Task;
+
+// Tasks which can be waited for or depended on together, the members are managed by JobSystem.cpp
+struct JobGroup {
+	JobGroup() : pending(0) {}
+	~JobGroup(); // waits for the tasks
+
+	bool done() const { return pending == 0; }
+
+	std::atomic<int> pending;
+	std::mutex mutex;
+	std::vector<Task*> continuations; // started when pending drops to 0
+};
+
+// name (a string literal) records the task's timing, see takeTaskTimings
+void runTask(const Job& task, JobGroup& group, const char* name = nullptr);
+
+// Like runTask, but the task only starts once everything in dependency is done
+void runTaskAfter(JobGroup& dependency, const Job& task, JobGroup& group, const char* name = nullptr);
+
+void waitForTasks(JobGroup& group);
+
+// Calls function(begin, end) for pieces of [0, count) of at most chunkSize in parallel and waits for them
+void parallelFor(int count, int chunkSize, const std::function<void(int, int)>& function, const char* name = nullptr);
+
+struct TaskTiming {
+	const char* name;
+	int thread; // 0 for threads which are not workers, like the render thread
+	double start; // System::time()
+	double end;
+};
+
+// Moves the timings of the named tasks which finished since the last call into timings
+void takeTaskTimings(std::vector<TaskTiming>& timings);
@@ -0,0 +1,219 @@
+#include "pch.h"
+#include "LightManager.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace Kore;
+
+namespace {
+	// Lights spanning more cells than this along an axis go into the unbounded list
+	const int maxCellsPerAxis = 4;
+
+	// Cell coordinates are clamped to 21 bits each so they pack into one key
+	const int cellCoordinateBits = 21;
+	const int maxCellCoordinate = (1 << (cellCoordinateBits - 1)) - 1;
+
+	int cellCoordinate(float value, float cellSize) {
+		float cell = std::floor(value / cellSize);
+		return (int)std::max(-(float)maxCellCoordinate, std::min((float)maxCellCoordinate, cell));
+	}
+
+	u64 cellKey(int x, int y, int z) {
+		const u64 offset = maxCellCoordinate + 1;
+		return ((x + offset) << (cellCoordinateBits * 2)) | ((y + offset) << cellCoordinateBits) | (z + offset);
+	}
+
+	size_t cellHash(u64 key) {
+		return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+
+	// Cells touched by the box around a sphere
+	void cellRange(const float* center, float radius, float cellSize, int* low, int* high) {
+		for (int axis = 0; axis < 3; ++axis) {
+			low[axis] = cellCoordinate(center[axis] - radius, cellSize);
+			high[axis] = cellCoordinate(center[axis] + radius, cellSize);
+		}
+	}
+}
+
+LightManager::LightManager() : cellSize(1.0f), dirty(true), query(0), tested(0) {}
+
+LightManager::~LightManager() {
+	clear();
+}
+
+Light* LightManager::addPointLight(const vec3& position, const vec3& color, float radius, u32 groups) {
+	Light* light = new Light(PointLight);
+
+	const vec4 ambient(1, 1, 1, 1);
+	const vec4 diffuse(color[0], color[1], color[2], 1);
+	const vec4 specular(1, 1, 1, 1);
+
+	light->setPosition(position);
+	light->setAttenuationRadius(radius);
+	light->setColors(ambient, diffuse, specular);
+
+	return add(light, position, radius, groups);
+}
+
+Light* LightManager::addSpotLight(const vec3& position, const vec3& color, float spotExponent, float spotCutoff, float radius, u32 groups) {
+	Light* light = new Light(SpotLight);
+
+	const vec4 ambient(1, 1, 1, 1);
+	const vec4 diffuse(color[0], color[1], color[2], 1);
+	const vec4 specular(1, 1, 1, 1);
+
+	light->setPosition(position);
+	light->setAttenuationRadius(radius);
+	light->setSpot(spotExponent, spotCutoff);
+	light->setColors(ambient, diffuse, specular);
+
+	return add(light, position, radius, groups);
+}
+
+Light* LightManager::add(Light* light, const vec3& position, float radius, u32 groups) {
+	Entry entry;
+	entry.light = light;
+	for (int axis = 0; axis < 3; ++axis) entry.position[axis] = position[axis];
+	entry.radius = radius;
+	entry.groups = groups;
+	lights.push_back(entry);
+	dirty = true;
+	return light;
+}
+
+void LightManager::clear() {
+	for (size_t i = 0; i < lights.size(); ++i) delete lights[i].light;
+	lights.clear();
+	dirty = true;
+}
+
+// Sorts the (cell, light) pairs by cell, every run of them becomes one slot of the table
+void LightManager::build() {
+	if (!lights.empty()) {
+		std::vector<float> diameters(lights.size());
+		for (size_t i = 0; i < lights.size(); ++i) diameters[i] = lights[i].radius * 2.0f;
+		std::nth_element(diameters.begin(), diameters.begin() + diameters.size() / 2, diameters.end());
+		if (diameters[diameters.size() / 2] > 0.0f) cellSize = diameters[diameters.size() / 2];
+	}
+
+	std::vector<std::pair<u64, int>> pairs;
+	unbounded.clear();
+	for (int i = 0; i < (int)lights.size(); ++i) {
+		int low[3], high[3];
+		cellRange(lights[i].position, lights[i].radius, cellSize, low, high);
+		if (high[0] - low[0] >= maxCellsPerAxis || high[1] - low[1] >= maxCellsPerAxis || high[2] - low[2] >= maxCellsPerAxis) {
+			unbounded.push_back(i);
+			continue;
+		}
+		for (int x = low[0]; x <= high[0]; ++x) {
+			for (int y = low[1]; y <= high[1]; ++y) {
+				for (int z = low[2]; z <= high[2]; ++z) pairs.push_back(std::make_pair(cellKey(x, y, z), i));
+			}
+		}
+	}
+	std::sort(pairs.begin(), pairs.end());
+
+	int occupied = 0;
+	for (size_t i = 0; i < pairs.size(); ++i) {
+		if (i == 0 || pairs[i].first != pairs[i - 1].first) ++occupied;
+	}
+	size_t size = 16;
+	while (size < (size_t)occupied * 2) size *= 2;
+	Cell empty = { 0, 0, 0 };
+	cells.assign(size, empty);
+
+	cellLights.resize(pairs.size());
+	for (size_t i = 0; i < pairs.size(); ++i) {
+		cellLights[i] = pairs[i].second;
+		if (i > 0 && pairs[i].first == pairs[i - 1].first) continue;
+		size_t slot = cellHash(pairs[i].first) & (size - 1);
+		while (cells[slot].count > 0) slot = (slot + 1) & (size - 1);
+		cells[slot].key = pairs[i].first;
+		cells[slot].start = (int)i;
+		size_t end = i + 1;
+		while (end < pairs.size() && pairs[end].first == pairs[i].first) ++end;
+		cells[slot].count = (int)(end - i);
+	}
+
+	visited.assign(lights.size(), -1);
+	query = 0;
+	dirty = false;
+}
+
+const LightManager::Cell* LightManager::findCell(u64 key) const {
+	const size_t mask = cells.size() - 1;
+	for (size_t slot = cellHash(key) & mask; cells[slot].count > 0; slot = (slot + 1) & mask) {
+		if (cells[slot].key == key) return &cells[slot];
+	}
+	return nullptr;
+}
+
+// Inserts the light into the candidates, which are kept ordered by influence
+void LightManager::consider(int light, const float* center, float radius, u32 groups, int& count, int maxSelected) {
+	if (visited[light] == query) return;
+	visited[light] = query;
+	++tested;
+
+	const Entry& entry = lights[light];
+	if ((entry.groups & groups) == 0 || entry.radius <= 0.0f) return;
+	float distanceSquared = 0;
+	for (int axis = 0; axis < 3; ++axis) {
+		float delta = entry.position[axis] - center[axis];
+		distanceSquared += delta * delta;
+	}
+	const float reach = radius + entry.radius;
+	if (distanceSquared >= reach * reach) return;
+
+	const float gap = std::max(0.0f, std::sqrt(distanceSquared) - radius);
+	const float influence = 1.0f - gap / entry.radius;
+
+	int position = count;
+	while (position > 0 && (influence > influences[position - 1] || (influence == influences[position - 1] && light < candidates[position - 1]))) --position;
+	if (position >= maxSelected) return;
+	if (count < maxSelected) ++count;
+	for (int i = count - 1; i > position; --i) {
+		candidates[i] = candidates[i - 1];
+		influences[i] = influences[i - 1];
+	}
+	candidates[position] = light;
+	influences[position] = influence;
+}
+
+int LightManager::select(const vec3& center, float radius, u32 groups, Light** selected, int maxSelected) {
+	if (dirty) build();
+	++query;
+	tested = 0;
+	if (maxSelected <= 0) return 0;
+	candidates.resize(std::max((int)candidates.size(), maxSelected));
+	influences.resize(candidates.size());
+
+	const float position[3] = { center[0], center[1], center[2] };
+	int count = 0;
+	for (size_t i = 0; i < unbounded.size(); ++i) consider(unbounded[i], position, radius, groups, count, maxSelected);
+
+	int low[3], high[3];
+	cellRange(position, radius, cellSize, low, high);
+	const double queryCells = (high[0] - low[0] + 1.0) * (high[1] - low[1] + 1.0) * (high[2] - low[2] + 1.0);
+	if (queryCells > (double)lights.size()) {
+		// Looking up every cell would take longer than looking at every light
+		for (int i = 0; i < (int)lights.size(); ++i) consider(i, position, radius, groups, count, maxSelected);
+	}
+	else {
+		for (int x = low[0]; x <= high[0]; ++x) {
+			for (int y = low[1]; y <= high[1]; ++y) {
+				for (int z = low[2]; z <= high[2]; ++z) {
+					const Cell* cell = findCell(cellKey(x, y, z));
+					if (cell == nullptr) continue;
+					for (int i = cell->start; i < cell->start + cell->count; ++i) {
+						consider(cellLights[i], position, radius, groups, count, maxSelected);
+					}
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < count; ++i) selected[i] = lights[candidates[i]].light;
+	return count;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Kore/Graphics3/Graphics.h>
+#include <vector>
+
+// Owns the lights of a scene, which can be thousands, and picks the few that Graphics3 can
+// light a draw with. The lights are kept in a hash grid of cubic cells, each light in every
+// cell its attenuation sphere touches, so a query only looks at the lights of the cells around
+// the object. The cells are as wide as the median light's sphere, lights reaching much further
+// are kept in a list which every query checks instead. The grid is rebuilt by the first query
+// after lights were added or cleared.
+class LightManager {
+public:
+	LightManager();
+	~LightManager();
+
+	// groups is a bit mask, select only considers lights sharing a bit with its mask
+	Kore::Light* addPointLight(const Kore::vec3& position, const Kore::vec3& color, float radius = 100.0f, Kore::u32 groups = 1);
+	Kore::Light* addSpotLight(const Kore::vec3& position, const Kore::vec3& color, float spotExponent, float spotCutoff, float radius = 100.0f,
+		Kore::u32 groups = 1);
+
+	// Deletes the lights
+	void clear();
+
+	int count() const { return (int)lights.size(); }
+
+	// Writes up to maxSelected lights whose attenuation spheres reach the sphere of center and radius
+	// into selected, the most influential first, and returns their number. A light's influence falls
+	// from 1 at the sphere to 0 at its attenuation radius, equal ones are ordered by when they were added.
+	int select(const Kore::vec3& center, float radius, Kore::u32 groups, Kore::Light** selected, int maxSelected);
+
+	// Lights looked at by the last select
+	int testedLights() const { return tested; }
+
+private:
+	LightManager(const LightManager&);
+	LightManager& operator=(const LightManager&);
+
+	struct Entry {
+		Kore::Light* light;
+		float position[3];
+		float radius;
+		Kore::u32 groups;
+	};
+
+	struct Cell {
+		Kore::u64 key; // packed cell coordinates
+		int start; // into cellLights
+		int count; // 0 for an empty slot
+	};
+
+	Kore::Light* add(Kore::Light* light, const Kore::vec3& position, float radius, Kore::u32 groups);
+	void build();
+	const Cell* findCell(Kore::u64 key) const;
+	void consider(int light, const float* center, float radius, Kore::u32 groups, int& count, int maxSelected);
+
+	float cellSize; // median light diameter, set by build
+	std::vector<Entry> lights;
+	bool dirty;
+
+	std::vector<Cell> cells; // open addressing, a power of two long
+	std::vector<int> cellLights;
+	std::vector<int> unbounded; // lights in too many cells
+	std::vector<int> visited; // query in which a light was last looked at
+	std::vector<int> candidates; // of the running select, by influence
+	std::vector<float> influences;
+	int query;
+	int tested;
+};
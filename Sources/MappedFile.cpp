@@ -0,0 +1,143 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#elif (defined(__unix__) || defined(__APPLE__)) && !defined(__ANDROID__)
+#define MAPPED_FILE_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Kore;
+
+MappedFile::MappedFile(const char* filename) : bytes(nullptr), length(0), mapped(false) {
+#ifdef _WIN32
+	file = nullptr;
+	mapping = nullptr;
+#endif
+	if (map(filename)) return;
+
+	// Assets which are not plain files (e.g. packed into an apk or app bundle) are read the usual way
+	if (reader.open(filename, FileReader::Asset)) {
+		length = reader.size();
+		bytes = static_cast<const char*>(reader.readAll());
+	}
+}
+
+MappedFile::~MappedFile() {
+	unmap();
+}
+
+u32 hashBytes(const char* data, int size) {
+	u32 h = 2166136261u;
+	for (int i = 0; i < size; ++i) {
+		h ^= (u8)data[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::map(const char* filename) {
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0 || fileSize.QuadPart > 0x7fffffff) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE fileMapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (fileMapping == nullptr) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	void* view = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(fileMapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file = handle;
+	mapping = fileMapping;
+	bytes = static_cast<const char*>(view);
+	length = (int)fileSize.QuadPart;
+	mapped = true;
+	return true;
+}
+
+void MappedFile::unmap() {
+	if (!mapped) return;
+	UnmapViewOfFile(bytes);
+	CloseHandle(mapping);
+	CloseHandle(file);
+	mapped = false;
+}
+
+bool fileStamp(const char* filename, FileStamp& stamp) {
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &info)) return false;
+	stamp.size = ((u64)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	stamp.modified = ((u64)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+#elif defined(MAPPED_FILE_POSIX)
+
+bool MappedFile::map(const char* filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0 || info.st_size > 0x7fffffff) {
+		close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file
+	close(fd);
+	if (view == MAP_FAILED) return false;
+	madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	bytes = static_cast<const char*>(view);
+	length = (int)info.st_size;
+	mapped = true;
+	return true;
+}
+
+void MappedFile::unmap() {
+	if (!mapped) return;
+	munmap(const_cast<char*>(bytes), (size_t)length);
+	mapped = false;
+}
+
+bool fileStamp(const char* filename, FileStamp& stamp) {
+	struct stat info;
+	if (stat(filename, &info) != 0 || !S_ISREG(info.st_mode)) return false;
+	stamp.size = (u64)info.st_size;
+	stamp.modified = (u64)info.st_mtime;
+	return true;
+}
+
+#else
+
+bool MappedFile::map(const char* filename) {
+	return false;
+}
+
+void MappedFile::unmap() {}
+
+bool fileStamp(const char* filename, FileStamp& stamp) {
+	return false;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Kore/IO/FileReader.h>
+
+// Read-only view of a whole asset file. Where the platform allows it the file is
+// memory mapped so it can be parsed without copying, otherwise it is read via FileReader.
+// The data is not zero terminated.
+class MappedFile {
+public:
+	MappedFile(const char* filename);
+	~MappedFile();
+
+	const char* data() const { return bytes; }
+	int size() const { return length; }
+	bool isMapped() const { return mapped; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	bool map(const char* filename);
+	void unmap();
+
+	const char* bytes;
+	int length;
+	bool mapped;
+	Kore::FileReader reader;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+};
+
+// Size and last modification of a plain file, false for assets which are not plain files
+struct FileStamp {
+	Kore::u64 size;
+	Kore::u64 modified; // platform specific units
+};
+
+bool fileStamp(const char* filename, FileStamp& stamp);
+
+// FNV-1a, baked files use it to recognize the asset they were made from where there is no FileStamp
+Kore::u32 hashBytes(const char* data, int size);
@@ -0,0 +1,138 @@
+#include "pch.h"
+#include "MeshBuffer.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+#include <cmath>
+#include <cstring>
+
+using namespace Kore;
+
+namespace {
+	// Share of maxPixelError a coarser level has to stay under before it replaces the current one
+	const float lodHysteresis = 0.75f;
+
+	// Centered on the middle of the bounding box
+	void computeBounds(const float* vertices, int numVertices, float scale, float* center, float& radius) {
+		float low[3] = { 0, 0, 0 }, high[3] = { 0, 0, 0 };
+		for (int i = 0; i < numVertices; ++i) {
+			for (int axis = 0; axis < 3; ++axis) {
+				float value = vertices[i * 8 + axis] * scale;
+				if (i == 0 || value < low[axis]) low[axis] = value;
+				if (i == 0 || value > high[axis]) high[axis] = value;
+			}
+		}
+		for (int axis = 0; axis < 3; ++axis) center[axis] = (low[axis] + high[axis]) * 0.5f;
+		float radiusSquared = 0;
+		for (int i = 0; i < numVertices; ++i) {
+			float distanceSquared = 0;
+			for (int axis = 0; axis < 3; ++axis) {
+				float offset = vertices[i * 8 + axis] * scale - center[axis];
+				distanceSquared += offset * offset;
+			}
+			if (distanceSquared > radiusSquared) radiusSquared = distanceSquared;
+		}
+		radius = std::sqrt(radiusSquared);
+	}
+}
+
+void copyMeshVertices(const Mesh& mesh, float scale, float* vertices)
+{
+    if (scale == 1.0f)
+    {
+        memcpy(vertices, mesh.vertices, mesh.numVertices * 8 * sizeof(float));
+        return;
+    }
+
+    float*       dst = vertices;
+    float const* src = mesh.vertices;
+
+	for (int i = 0; i < mesh.numVertices; ++i) {
+        // copy coord
+		dst[0] = src[0] * scale;
+		dst[1] = src[1] * scale;
+		dst[2] = src[2] * scale;
+
+        // copy tex-coord
+		dst[3] = src[3];
+		dst[4] = src[4];
+
+        // copy normal
+		dst[5] = src[5];
+		dst[6] = src[6];
+		dst[7] = src[7];
+
+        dst += 8;
+        src += 8;
+	}
+}
+
+MeshBuffer* createMeshBuffer(
+    const Mesh& mesh,
+    const Graphics4::VertexStructure& vertexStructure,
+    float scale)
+{
+    MeshBuffer* meshBuffer = new MeshBuffer();
+
+	meshBuffer->vertexBuffer = new Graphics3::VertexBuffer(mesh.numVertices, vertexStructure, 0);
+	copyMeshVertices(mesh, scale, meshBuffer->vertexBuffer->lock());
+	meshBuffer->vertexBuffer->unlock();
+
+	meshBuffer->indexBuffer = new Graphics3::IndexBuffer(mesh.numFaces * 3);
+	memcpy(meshBuffer->indexBuffer->lock(), mesh.indices, mesh.numFaces * 3 * sizeof(int));
+	meshBuffer->indexBuffer->unlock();
+
+    meshBuffer->sizeInBytes = mesh.numVertices * 8 * sizeof(float) + mesh.numFaces * 3 * sizeof(int);
+    computeBounds(mesh.vertices, mesh.numVertices, scale, meshBuffer->center, meshBuffer->radius);
+    return meshBuffer;
+}
+
+void addMeshLods(MeshBuffer* meshBuffer, const MeshLod* lods, int count)
+{
+	for (int level = 0; level < count && meshBuffer->numLods < maxMeshLods; ++level) {
+		const std::vector<int>& indices = lods[level].indices;
+		Graphics3::IndexBuffer* indexBuffer = new Graphics3::IndexBuffer((int)indices.size());
+		int* target = indexBuffer->lock();
+		for (size_t i = 0; i < indices.size(); ++i) {
+			target[i] = indices[i];
+		}
+		indexBuffer->unlock();
+
+		meshBuffer->lodIndexBuffers[meshBuffer->numLods] = indexBuffer;
+		meshBuffer->lodErrors[meshBuffer->numLods] = lods[level].error;
+		++meshBuffer->numLods;
+		meshBuffer->sizeInBytes += (int)(indices.size() * sizeof(int));
+	}
+}
+
+void viewSpaceCenter(const MeshBuffer& meshBuffer, const mat4& modelView, float* center)
+{
+	for (int row = 0; row < 3; ++row) {
+		center[row] = modelView.get(row, 0) * meshBuffer.center[0] + modelView.get(row, 1) * meshBuffer.center[1]
+			+ modelView.get(row, 2) * meshBuffer.center[2] + modelView.get(row, 3);
+	}
+}
+
+int selectMeshLod(const MeshBuffer& meshBuffer, const mat4& projection, const mat4& modelView,
+    int screenHeight, int currentLevel, float maxPixelError)
+{
+	// Clip space w of the bounding sphere's nearest point, 1 for orthographic projections
+	float view[3];
+	viewSpaceCenter(meshBuffer, modelView, view);
+	float w = projection.get(3, 3);
+	for (int column = 0; column < 3; ++column) {
+		w += projection.get(3, column) * view[column];
+	}
+	float distance = std::fabs(w);
+	if (projection.get(3, 3) == 0.0f) distance -= meshBuffer.radius;
+	if (distance <= 0.0f) return 0;
+
+	// Pixels per unit of error at that distance
+	const float pixelsPerUnit = std::fabs(projection.get(1, 1)) * screenHeight * 0.5f / distance;
+
+	int level = 0;
+	for (int candidate = 1; candidate < meshBuffer.levels(); ++candidate) {
+		if (meshBuffer.levelError(candidate) * pixelsPerUnit <= maxPixelError) level = candidate;
+	}
+	while (level > currentLevel && meshBuffer.levelError(level) * pixelsPerUnit > maxPixelError * lodHysteresis) --level;
+	return level;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "MeshTiles.h"
+#include <Kore/Graphics3/Graphics.h>
+
+struct Mesh;
+struct MeshLod;
+
+// Simplified index buffers a mesh buffer can hold next to the full one, see MeshSimplifier.h
+const int maxMeshLods = 4;
+
+struct MeshBuffer {
+    MeshBuffer() : vertexBuffer(nullptr), indexBuffer(nullptr), sizeInBytes(0), numLods(0), radius(0), tiles(nullptr) {
+        for (int i = 0; i < maxMeshLods; ++i) {
+            lodIndexBuffers[i] = nullptr;
+            lodErrors[i] = 0;
+        }
+        center[0] = center[1] = center[2] = 0;
+    }
+    ~MeshBuffer() {
+        delete vertexBuffer;
+        delete indexBuffer;
+        for (int i = 0; i < numLods; ++i)
+            delete lodIndexBuffers[i];
+        delete tiles;
+    }
+
+    // Level 0 is the full mesh, the others use the same vertex buffer with fewer triangles
+    Kore::Graphics3::IndexBuffer* levelIndexBuffer(int level) const { return level == 0 ? indexBuffer : lodIndexBuffers[level - 1]; }
+    float levelError(int level) const { return level == 0 ? 0.0f : lodErrors[level - 1]; }
+    int levels() const { return numLods + 1; }
+
+	Kore::Graphics3::VertexBuffer* vertexBuffer;
+	Kore::Graphics3::IndexBuffer* indexBuffer;
+	int sizeInBytes; // of all buffers
+
+	Kore::Graphics3::IndexBuffer* lodIndexBuffers[maxMeshLods];
+	float lodErrors[maxMeshLods];
+	int numLods;
+
+	// Bounding sphere of the scaled positions
+	float center[3];
+	float radius;
+
+	// Ranges of indexBuffer to cull before drawing, nullptr if the mesh is drawn whole.
+	// Only valid for level 0, the simplified levels are not sorted into tiles.
+	MeshTiles* tiles;
+};
+
+MeshBuffer* createMeshBuffer(
+    const Mesh& mesh,
+    const Kore::Graphics4::VertexStructure& vertexStructure,
+    float scale = 1.0f);
+
+// Uploads up to maxMeshLods simplified index lists, coarsest last. Their errors have to be in the
+// units of the buffer's positions, so the mesh should be simplified after it was scaled.
+void addMeshLods(MeshBuffer* meshBuffer, const MeshLod* lods, int count);
+
+// Writes the center of meshBuffer's bounding sphere transformed by modelView, which must be affine
+void viewSpaceCenter(const MeshBuffer& meshBuffer, const Kore::mat4& modelView, float* center);
+
+// Level of detail to draw meshBuffer with: the coarsest level whose error projects to at most
+// maxPixelError pixels. modelView must not scale. A coarser level is only taken over
+// currentLevel once it is clearly within the bound, so the level does not flicker when the
+// error sits right at the bound.
+int selectMeshLod(const MeshBuffer& meshBuffer, const Kore::mat4& projection, const Kore::mat4& modelView,
+    int screenHeight, int currentLevel, float maxPixelError = 1.0f);
+
+// The vertex loop of createMeshBuffer: writes mesh.numVertices * 8 floats with the positions scaled
+void copyMeshVertices(const Mesh& mesh, float scale, float* vertices);
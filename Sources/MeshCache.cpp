@@ -0,0 +1,187 @@
+#include "pch.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace Kore;
+
+namespace {
+	const char magic[4] = { 'K', 'M', 'S', 'H' };
+
+	int indexSize(u32 flags) {
+		return (flags & bakedMeshShortIndices) ? (int)sizeof(u16) : (int)sizeof(int);
+	}
+
+	int bakedMeshSize(const BakedMeshHeader& header) {
+		const int numVertices = header.numVertices;
+		const u32 flags = header.flags;
+		int size = (int)sizeof(BakedMeshHeader);
+		if (flags & bakedMeshPacked) {
+			size += (int)sizeof(PackedMeshBounds) + numVertices * (int)sizeof(PackedVertex);
+		}
+		else {
+			size += numVertices * bakedMeshVertexSize * (int)sizeof(float);
+		}
+		size += header.numLods * (int)sizeof(BakedMeshLod);
+		return size + (header.numIndices + header.numLodIndices) * indexSize(flags);
+	}
+
+	// The table may sit on a 2 byte boundary after 16 bit indices
+	BakedMeshLod readLod(const char* table, int level) {
+		BakedMeshLod lod;
+		memcpy(&lod, table + level * sizeof(BakedMeshLod), sizeof(lod));
+		return lod;
+	}
+
+	bool writeIndices(FILE* file, const int* indices, int count, bool shortIndices) {
+		if (count == 0) return true;
+		if (shortIndices) {
+			std::vector<u16> packed(count);
+			packIndices(indices, count, packed.data());
+			return fwrite(packed.data(), sizeof(u16), count, file) == (size_t)count;
+		}
+		return fwrite(indices, sizeof(int), count, file) == (size_t)count;
+	}
+
+	void readIndices(const char* data, int count, bool shortIndices, int* target) {
+		if (shortIndices) unpackIndices(reinterpret_cast<const u16*>(data), count, target);
+		else memcpy(target, data, count * sizeof(int));
+	}
+
+	bool sourceMatches(const BakedMeshHeader& header, const char* objFilename) {
+		FileStamp stamp;
+		if (fileStamp(objFilename, stamp)) return header.sourceSize == stamp.size && header.sourceModified != 0 && header.sourceModified == stamp.modified;
+
+		MappedFile source(objFilename);
+		return source.data() != nullptr && header.sourceSize == (u32)source.size() && header.sourceHash == hashBytes(source.data(), source.size());
+	}
+}
+
+BakedMesh::BakedMesh(const char* kmeshFilename, const char* objFilename, float scale, bool optimize) : file(kmeshFilename), header(nullptr) {
+	if (file.data() == nullptr || file.size() < (int)sizeof(BakedMeshHeader)) return;
+
+	const BakedMeshHeader* candidate = reinterpret_cast<const BakedMeshHeader*>(file.data());
+	if (memcmp(candidate->magic, magic, 4) != 0 || candidate->version != bakedMeshVersion || candidate->scale != scale) return;
+	if (((candidate->flags & bakedMeshOptimized) != 0) != optimize) return;
+	if (candidate->numVertices < 0 || candidate->numIndices < 0 || candidate->numLods < 0 || candidate->numLodIndices < 0) return;
+
+	if (file.size() != bakedMeshSize(*candidate)) return;
+
+	if (!sourceMatches(*candidate, objFilename)) return;
+
+	header = candidate;
+	int lodIndices = 0;
+	for (int level = 0; level < numLods(); ++level) {
+		BakedMeshLod lod = readLod(lodData(), level);
+		if (lod.numIndices < 0 || lod.numIndices % 3 != 0) {
+			header = nullptr;
+			return;
+		}
+		lodIndices += lod.numIndices;
+	}
+	if (lodIndices != header->numLodIndices) header = nullptr;
+}
+
+const char* BakedMesh::vertexData() const {
+	return file.data() + sizeof(BakedMeshHeader) + (packed() ? sizeof(PackedMeshBounds) : 0);
+}
+
+const char* BakedMesh::indexData() const {
+	return vertexData() + header->numVertices * (packed() ? sizeof(PackedVertex) : bakedMeshVertexSize * sizeof(float));
+}
+
+void BakedMesh::copyVertices(float* target) const {
+	if (packed()) {
+		const PackedMeshBounds* bounds = reinterpret_cast<const PackedMeshBounds*>(file.data() + sizeof(BakedMeshHeader));
+		unpackVertices(reinterpret_cast<const PackedVertex*>(vertexData()), header->numVertices, *bounds, target);
+	}
+	else {
+		memcpy(target, vertexData(), header->numVertices * bakedMeshVertexSize * sizeof(float));
+	}
+}
+
+const char* BakedMesh::lodData() const {
+	return indexData() + header->numIndices * indexSize(header->flags);
+}
+
+void BakedMesh::copyIndices(int* target) const {
+	readIndices(indexData(), header->numIndices, (header->flags & bakedMeshShortIndices) != 0, target);
+}
+
+void BakedMesh::copyLods(std::vector<MeshLod>& lods) const {
+	lods.resize(header->numLods);
+	const char* indices = lodData() + header->numLods * sizeof(BakedMeshLod);
+	for (int level = 0; level < header->numLods; ++level) {
+		BakedMeshLod lod = readLod(lodData(), level);
+		lods[level].error = lod.error;
+		lods[level].indices.resize(lod.numIndices);
+		readIndices(indices, lod.numIndices, (header->flags & bakedMeshShortIndices) != 0, lods[level].indices.data());
+		indices += lod.numIndices * indexSize(header->flags);
+	}
+}
+
+bool bakeMesh(const char* objFilename, const char* kmeshFilename, float scale, bool optimize, bool pack, int lods) {
+	MappedFile source(objFilename);
+	if (source.data() == nullptr) return false;
+
+	Mesh mesh = loadObj(objFilename, scale);
+	if (optimize) optimizeMesh(&mesh);
+	std::vector<MeshLod> levels;
+	buildMeshLods(mesh, lods, levels);
+
+	BakedMeshHeader header;
+	memcpy(header.magic, magic, 4);
+	header.version = bakedMeshVersion;
+	header.sourceSize = (u32)source.size();
+	header.sourceHash = hashBytes(source.data(), source.size());
+	FileStamp stamp;
+	header.sourceModified = fileStamp(objFilename, stamp) ? stamp.modified : 0;
+	header.scale = scale;
+	header.numVertices = mesh.numVertices;
+	header.numIndices = mesh.numFaces * 3;
+	header.flags = optimize ? bakedMeshOptimized : 0;
+	if (pack) header.flags |= bakedMeshPacked;
+	if (pack && fitsShortIndices(mesh.numVertices)) header.flags |= bakedMeshShortIndices;
+	header.numLods = (s32)levels.size();
+	header.numLodIndices = 0;
+	for (size_t level = 0; level < levels.size(); ++level) header.numLodIndices += (s32)levels[level].indices.size();
+
+	// Written with stdio instead of FileWriter, which targets the save directory rather than the assets
+	FILE* file = fopen(kmeshFilename, "wb");
+	bool success = file != nullptr;
+	if (success) {
+		success = fwrite(&header, sizeof(header), 1, file) == 1;
+		if (pack) {
+			PackedMeshBounds bounds;
+			computePackedMeshBounds(mesh.vertices, mesh.numVertices, bounds);
+			std::vector<PackedVertex> vertices(mesh.numVertices);
+			packVertices(mesh.vertices, mesh.numVertices, bounds, vertices.data());
+			if (success) success = fwrite(&bounds, sizeof(bounds), 1, file) == 1;
+			if (success && header.numVertices > 0) success = fwrite(vertices.data(), sizeof(PackedVertex), header.numVertices, file) == (size_t)header.numVertices;
+		}
+		else {
+			if (success && header.numVertices > 0) success = fwrite(mesh.vertices, sizeof(float) * bakedMeshVertexSize, header.numVertices, file) == (size_t)header.numVertices;
+		}
+		const bool shortIndices = (header.flags & bakedMeshShortIndices) != 0;
+		if (success) success = writeIndices(file, mesh.indices, header.numIndices, shortIndices);
+		for (size_t level = 0; success && level < levels.size(); ++level) {
+			BakedMeshLod lod = { (s32)levels[level].indices.size(), levels[level].error };
+			success = fwrite(&lod, sizeof(lod), 1, file) == 1;
+		}
+		for (size_t level = 0; success && level < levels.size(); ++level) {
+			success = writeIndices(file, levels[level].indices.data(), (int)levels[level].indices.size(), shortIndices);
+		}
+		success = fclose(file) == 0 && success;
+		if (!success) remove(kmeshFilename);
+	}
+
+	return success;
+}
+
+std::string bakedMeshFilename(const std::string& objFilename) {
+	std::string::size_type dot = objFilename.find_last_of('.');
+	return (dot == std::string::npos ? objFilename : objFilename.substr(0, dot)) + ".kmesh";
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "MeshPacking.h"
+#include "MeshSimplifier.h"
+#include <string>
+#include <vector>
+
+// Baked meshes (.kmesh) hold a mesh in exactly the layout createMeshBuffer uploads:
+// interleaved position/uv/normal (8 floats) per vertex with the scale already applied,
+// followed by the 32 bit index array and the levels of detail. Packed meshes instead hold PackedMeshBounds,
+// PackedVertex data and 16 bit indices where they fit (see MeshPacking.h), which
+// are expanded while uploading. The header remembers the OBJ it was baked from
+// so a stale file is ignored and the OBJ is parsed again. Loading only compares the
+// OBJ's size and modification time (see FileStamp), the hash of its bytes is only
+// compared where the OBJ is not a plain file. Anything which touches the OBJ, like a
+// fresh checkout, makes the baked file stale until it is baked again.
+struct BakedMeshHeader {
+	char magic[4];
+	Kore::u32 version;
+	Kore::u32 sourceSize;
+	Kore::u32 sourceHash;
+	float scale;
+	Kore::s32 numVertices;
+	Kore::s32 numIndices;
+	Kore::u32 flags;
+	Kore::u64 sourceModified; // FileStamp::modified, 0 if there was none
+	Kore::s32 numLods;
+	Kore::s32 numLodIndices; // of all levels together
+};
+
+// Follows the index array once per level, then come the levels' indices in the same width as it
+struct BakedMeshLod {
+	Kore::s32 numIndices;
+	float error;
+};
+
+// BakedMeshHeader::flags
+const Kore::u32 bakedMeshOptimized = 1;
+const Kore::u32 bakedMeshPacked = 2;
+const Kore::u32 bakedMeshShortIndices = 4;
+
+const int bakedMeshVersion = 5;
+const int bakedMeshVertexSize = 8;
+
+class BakedMesh {
+public:
+	// Maps kmeshFilename, valid() is false if it is missing, corrupt or does not match objFilename/scale/optimize
+	BakedMesh(const char* kmeshFilename, const char* objFilename, float scale, bool optimize);
+
+	bool valid() const { return header != nullptr; }
+	int numVertices() const { return header->numVertices; }
+	int numIndices() const { return header->numIndices; }
+	bool packed() const { return (header->flags & bakedMeshPacked) != 0; }
+	int numLods() const { return header->numLods; }
+
+	// Fill numVertices() * bakedMeshVertexSize floats and numIndices() ints
+	void copyVertices(float* target) const;
+	void copyIndices(int* target) const;
+	// Replaces lods with the levels built by bakeMesh, most detailed first
+	void copyLods(std::vector<MeshLod>& lods) const;
+
+private:
+	const char* vertexData() const;
+	const char* indexData() const;
+	const char* lodData() const;
+
+	MappedFile file;
+	const BakedMeshHeader* header;
+};
+
+// Offline step: parses objFilename, applies scale, optionally runs optimizeMesh and packs the mesh,
+// builds up to lods levels of detail (see buildMeshLods) and writes kmeshFilename
+bool bakeMesh(const char* objFilename, const char* kmeshFilename, float scale, bool optimize, bool pack, int lods);
+
+// "Terrain.obj" -> "Terrain.kmesh"
+std::string bakedMeshFilename(const std::string& objFilename);
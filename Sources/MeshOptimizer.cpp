@@ -0,0 +1,239 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
+#include "ScratchArena.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+	// Size of the LRU cache the triangle scores are based on, a bit larger than real hardware caches
+	const int scoringCacheSize = 32;
+	const float cacheDecayPower = 1.5f;
+	const float lastTriangleScore = 0.75f;
+	const float valenceBoostScale = 2.0f;
+	const float valenceBoostPower = 0.5f;
+	const int maxValence = 64;
+
+	// Scores of a vertex by its LRU cache position and by the number of triangles it still has to be used in
+	struct VertexScores {
+		float cache[scoringCacheSize];
+		float valence[maxValence];
+
+		VertexScores() {
+			for (int i = 0; i < scoringCacheSize; ++i) {
+				// The vertices of the last triangle get a fixed score so it is not repeated directly
+				if (i < 3) {
+					cache[i] = lastTriangleScore;
+				}
+				else {
+					float scaler = 1.0f / (scoringCacheSize - 3);
+					cache[i] = std::pow(1.0f - (i - 3) * scaler, cacheDecayPower);
+				}
+			}
+			valence[0] = 0;
+			for (int i = 1; i < maxValence; ++i) {
+				// Boost vertices with few triangles left so they are finished off
+				valence[i] = valenceBoostScale * std::pow((float)i, -valenceBoostPower);
+			}
+		}
+
+		float score(int cachePosition, int remainingTriangles) const {
+			if (remainingTriangles == 0) return -1.0f;
+			float score = cachePosition < 0 ? 0.0f : cache[cachePosition];
+			return score + valence[remainingTriangles < maxValence ? remainingTriangles : maxValence - 1];
+		}
+	};
+
+	struct OptimizerVertex {
+		int firstTriangle; // into the adjacency list
+		int remainingTriangles;
+		int cachePosition;
+		float score;
+	};
+
+	void reorderTriangles(int* indices, int numIndices, int numVertices) {
+		const VertexScores scores;
+		const int numTriangles = numIndices / 3;
+
+		std::vector<OptimizerVertex> vertices(numVertices);
+		for (int i = 0; i < numVertices; ++i) {
+			vertices[i].remainingTriangles = 0;
+			vertices[i].cachePosition = -1;
+		}
+		for (int i = 0; i < numIndices; ++i) ++vertices[indices[i]].remainingTriangles;
+
+		// Triangles of every vertex, the ones still to be added are kept at the front of each range
+		std::vector<int> adjacency(numIndices);
+		int offset = 0;
+		for (int i = 0; i < numVertices; ++i) {
+			vertices[i].firstTriangle = offset;
+			offset += vertices[i].remainingTriangles;
+			vertices[i].remainingTriangles = 0;
+		}
+		for (int triangle = 0; triangle < numTriangles; ++triangle) {
+			for (int corner = 0; corner < 3; ++corner) {
+				OptimizerVertex& vertex = vertices[indices[triangle * 3 + corner]];
+				adjacency[vertex.firstTriangle + vertex.remainingTriangles++] = triangle;
+			}
+		}
+		for (int i = 0; i < numVertices; ++i) {
+			vertices[i].score = scores.score(-1, vertices[i].remainingTriangles);
+		}
+
+		std::vector<float> triangleScores(numTriangles);
+		std::vector<bool> added(numTriangles, false);
+		for (int triangle = 0; triangle < numTriangles; ++triangle) {
+			triangleScores[triangle] = vertices[indices[triangle * 3]].score + vertices[indices[triangle * 3 + 1]].score + vertices[indices[triangle * 3 + 2]].score;
+		}
+
+		std::vector<int> output(numIndices);
+		int cache[scoringCacheSize + 3];
+		int cacheCount = 0;
+		int scanPosition = 0;
+		int bestTriangle = -1;
+
+		for (int outputTriangle = 0; outputTriangle < numTriangles; ++outputTriangle) {
+			if (bestTriangle < 0) {
+				// Nothing useful in the cache, continue with the best triangle that is left
+				float bestScore = -1.0f;
+				while (scanPosition < numTriangles && added[scanPosition]) ++scanPosition;
+				for (int triangle = scanPosition; triangle < numTriangles; ++triangle) {
+					if (!added[triangle] && triangleScores[triangle] > bestScore) {
+						bestScore = triangleScores[triangle];
+						bestTriangle = triangle;
+					}
+				}
+			}
+
+			added[bestTriangle] = true;
+			const int* corners = &indices[bestTriangle * 3];
+			memcpy(&output[outputTriangle * 3], corners, 3 * sizeof(int));
+
+			// Take the triangle out of its vertices' lists
+			for (int corner = 0; corner < 3; ++corner) {
+				OptimizerVertex& vertex = vertices[corners[corner]];
+				int* triangles = &adjacency[vertex.firstTriangle];
+				for (int i = 0; i < vertex.remainingTriangles; ++i) {
+					if (triangles[i] == bestTriangle) {
+						triangles[i] = triangles[vertex.remainingTriangles - 1];
+						break;
+					}
+				}
+				--vertex.remainingTriangles;
+			}
+
+			// Move the triangle's vertices to the front of the LRU cache
+			int newCache[scoringCacheSize + 3];
+			int newCount = 0;
+			for (int corner = 0; corner < 3; ++corner) {
+				if (corner > 0 && corners[corner] == corners[0]) continue;
+				if (corner > 1 && corners[corner] == corners[1]) continue;
+				newCache[newCount++] = corners[corner];
+			}
+			for (int i = 0; i < cacheCount; ++i) {
+				int vertex = cache[i];
+				if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2]) newCache[newCount++] = vertex;
+			}
+			for (int i = scoringCacheSize; i < newCount; ++i) {
+				// Fell out of the cache
+				vertices[newCache[i]].cachePosition = -1;
+				vertices[newCache[i]].score = scores.score(-1, vertices[newCache[i]].remainingTriangles);
+			}
+			cacheCount = newCount < scoringCacheSize ? newCount : scoringCacheSize;
+			memcpy(cache, newCache, cacheCount * sizeof(int));
+
+			// Rescore everything in the cache and pick the next triangle among their triangles
+			for (int i = 0; i < cacheCount; ++i) {
+				OptimizerVertex& vertex = vertices[cache[i]];
+				vertex.cachePosition = i;
+				float newScore = scores.score(i, vertex.remainingTriangles);
+				float difference = newScore - vertex.score;
+				vertex.score = newScore;
+				for (int j = 0; j < vertex.remainingTriangles; ++j) {
+					triangleScores[adjacency[vertex.firstTriangle + j]] += difference;
+				}
+			}
+
+			bestTriangle = -1;
+			float bestScore = -1.0f;
+			for (int i = 0; i < cacheCount; ++i) {
+				const OptimizerVertex& vertex = vertices[cache[i]];
+				for (int j = 0; j < vertex.remainingTriangles; ++j) {
+					int triangle = adjacency[vertex.firstTriangle + j];
+					if (triangleScores[triangle] > bestScore) {
+						bestScore = triangleScores[triangle];
+						bestTriangle = triangle;
+					}
+				}
+			}
+		}
+
+		memcpy(indices, output.data(), numIndices * sizeof(int));
+	}
+
+	// Renumbers the vertices in the order the index buffer first uses them
+	void reorderVertices(Mesh* mesh) {
+		ScratchArena& scratch = ScratchArena::local();
+		ScratchArena::Scope scope(scratch);
+		const int numIndices = mesh->numFaces * 3;
+		int* remap = scratch.allocate<int>(mesh->numVertices);
+		for (int i = 0; i < mesh->numVertices; ++i) remap[i] = -1;
+		int next = 0;
+		for (int i = 0; i < numIndices; ++i) {
+			int& target = remap[mesh->indices[i]];
+			if (target < 0) target = next++;
+			mesh->indices[i] = target;
+		}
+		// Unreferenced vertices go to the end
+		for (int i = 0; i < mesh->numVertices; ++i) {
+			if (remap[i] < 0) remap[i] = next++;
+		}
+
+		// The mesh's storage is kept, the old order is copied out of the way
+		float* vertices = scratch.allocate<float>(mesh->numVertices * 8);
+		memcpy(vertices, mesh->vertices, mesh->numVertices * 8 * sizeof(float));
+		for (int i = 0; i < mesh->numVertices; ++i) {
+			memcpy(&mesh->vertices[remap[i] * 8], &vertices[i * 8], 8 * sizeof(float));
+		}
+	}
+}
+
+int countTransformedVertices(const int* indices, int numIndices, int cacheSize) {
+	int numVertices = 0;
+	for (int i = 0; i < numIndices; ++i) {
+		if (indices[i] >= numVertices) numVertices = indices[i] + 1;
+	}
+
+	// A vertex is in the FIFO cache if fewer than cacheSize others were transformed since it was
+	std::vector<int> transformedAt(numVertices, -cacheSize - 1);
+	int transformed = 0;
+	for (int i = 0; i < numIndices; ++i) {
+		int& time = transformedAt[indices[i]];
+		if (transformed - time > cacheSize) {
+			time = transformed;
+			++transformed;
+		}
+	}
+	return transformed;
+}
+
+void optimizeMesh(Mesh* mesh, MeshOptimizationStats* stats) {
+	const int numIndices = mesh->numFaces * 3;
+	if (numIndices == 0) {
+		if (stats != nullptr) memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	int before = countTransformedVertices(mesh->indices, numIndices);
+	reorderTriangles(mesh->indices, numIndices, mesh->numVertices);
+	reorderVertices(mesh);
+	int after = countTransformedVertices(mesh->indices, numIndices);
+
+	if (stats != nullptr) {
+		stats->acmrBefore = (float)before / mesh->numFaces;
+		stats->acmrAfter = (float)after / mesh->numFaces;
+		stats->atvrBefore = (float)before / mesh->numVertices;
+		stats->atvrAfter = (float)after / mesh->numVertices;
+	}
+}
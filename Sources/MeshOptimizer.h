@@ -0,0 +1,21 @@
+#pragma once
+
+struct Mesh;
+
+// Simulated FIFO post-transform cache, the numbers below are measured against this size
+const int vertexCacheSize = 16;
+
+struct MeshOptimizationStats {
+	float acmrBefore; // transformed vertices per triangle
+	float acmrAfter;
+	float atvrBefore; // transformed vertices per vertex
+	float atvrAfter;
+};
+
+// Reorders the triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm),
+// then the vertices in order of their first use so vertex fetch walks the buffer front to back.
+// The mesh keeps its vertices and triangles, only their order changes.
+void optimizeMesh(Mesh* mesh, MeshOptimizationStats* stats = nullptr);
+
+// Number of vertices a FIFO cache of cacheSize entries transforms for the index list
+int countTransformedVertices(const int* indices, int numIndices, int cacheSize = vertexCacheSize);
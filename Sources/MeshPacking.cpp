@@ -0,0 +1,149 @@
+#include "pch.h"
+#include "MeshPacking.h"
+#include <cmath>
+
+using namespace Kore;
+
+namespace {
+	const float snormScale = 32767.0f;
+	const float unormScale = 65535.0f;
+
+	float clampUnit(float value) {
+		return value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	}
+
+	s16 toSnorm(float value) {
+		return (s16)std::floor(clampUnit(value) * snormScale + 0.5f);
+	}
+
+	float fromSnorm(s16 value) {
+		return value < -32767 ? -1.0f : value / snormScale;
+	}
+
+	// Maps value from [min, max] to [-1, 1]
+	s16 packRange(float value, float min, float max) {
+		float extent = max - min;
+		return extent > 0 ? toSnorm((value - min) / extent * 2.0f - 1.0f) : 0;
+	}
+
+	float unpackRange(s16 value, float min, float max) {
+		return min + (fromSnorm(value) + 1.0f) * 0.5f * (max - min);
+	}
+
+	u16 packUnorm(float value, float min, float max) {
+		float extent = max - min;
+		if (extent <= 0) return 0;
+		float unit = (value - min) / extent;
+		unit = unit < 0 ? 0 : (unit > 1 ? 1 : unit);
+		return (u16)std::floor(unit * unormScale + 0.5f);
+	}
+
+	float unpackUnorm(u16 value, float min, float max) {
+		return min + value / unormScale * (max - min);
+	}
+
+	float signNotZero(float value) {
+		return value >= 0 ? 1.0f : -1.0f;
+	}
+
+	// Octahedral normal encoding (Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors")
+	bool encodeOctahedral(const float* normal, s16* packed) {
+		float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+		if (length <= 0) {
+			packed[0] = packed[1] = 0;
+			return false;
+		}
+		float x = normal[0] / length;
+		float y = normal[1] / length;
+		if (normal[2] < 0) {
+			float foldedX = (1.0f - std::fabs(y)) * signNotZero(x);
+			float foldedY = (1.0f - std::fabs(x)) * signNotZero(y);
+			x = foldedX;
+			y = foldedY;
+		}
+		packed[0] = toSnorm(x);
+		packed[1] = toSnorm(y);
+		return true;
+	}
+
+	void decodeOctahedral(const s16* packed, float* normal) {
+		float x = fromSnorm(packed[0]);
+		float y = fromSnorm(packed[1]);
+		float z = 1.0f - std::fabs(x) - std::fabs(y);
+		if (z < 0) {
+			float unfoldedX = (1.0f - std::fabs(y)) * signNotZero(x);
+			float unfoldedY = (1.0f - std::fabs(x)) * signNotZero(y);
+			x = unfoldedX;
+			y = unfoldedY;
+		}
+		float length = std::sqrt(x * x + y * y + z * z);
+		normal[0] = x / length;
+		normal[1] = y / length;
+		normal[2] = z / length;
+	}
+}
+
+int unpackedMeshSize(int numVertices, int numIndices) {
+	return numVertices * 8 * (int)sizeof(float) + numIndices * (int)sizeof(int);
+}
+
+int packedMeshSize(int numVertices, int numIndices) {
+	int indexSize = fitsShortIndices(numVertices) ? (int)sizeof(u16) : (int)sizeof(int);
+	return (int)sizeof(PackedMeshBounds) + numVertices * (int)sizeof(PackedVertex) + numIndices * indexSize;
+}
+
+void computePackedMeshBounds(const float* vertices, int numVertices, PackedMeshBounds& bounds) {
+	for (int i = 0; i < 3; ++i) {
+		bounds.positionMin[i] = numVertices > 0 ? vertices[i] : 0;
+		bounds.positionMax[i] = bounds.positionMin[i];
+	}
+	for (int i = 0; i < 2; ++i) {
+		bounds.uvMin[i] = numVertices > 0 ? vertices[3 + i] : 0;
+		bounds.uvMax[i] = bounds.uvMin[i];
+	}
+	for (int vertex = 1; vertex < numVertices; ++vertex) {
+		const float* v = &vertices[vertex * 8];
+		for (int i = 0; i < 3; ++i) {
+			if (v[i] < bounds.positionMin[i]) bounds.positionMin[i] = v[i];
+			if (v[i] > bounds.positionMax[i]) bounds.positionMax[i] = v[i];
+		}
+		for (int i = 0; i < 2; ++i) {
+			if (v[3 + i] < bounds.uvMin[i]) bounds.uvMin[i] = v[3 + i];
+			if (v[3 + i] > bounds.uvMax[i]) bounds.uvMax[i] = v[3 + i];
+		}
+	}
+}
+
+void packVertices(const float* vertices, int numVertices, const PackedMeshBounds& bounds, PackedVertex* packed) {
+	for (int vertex = 0; vertex < numVertices; ++vertex) {
+		const float* v = &vertices[vertex * 8];
+		PackedVertex& p = packed[vertex];
+		for (int i = 0; i < 3; ++i) p.position[i] = packRange(v[i], bounds.positionMin[i], bounds.positionMax[i]);
+		for (int i = 0; i < 2; ++i) p.uv[i] = packUnorm(v[3 + i], bounds.uvMin[i], bounds.uvMax[i]);
+		p.position[3] = encodeOctahedral(&v[5], p.normal) ? 1 : 0;
+	}
+}
+
+void unpackVertices(const PackedVertex* packed, int numVertices, const PackedMeshBounds& bounds, float* vertices) {
+	for (int vertex = 0; vertex < numVertices; ++vertex) {
+		const PackedVertex& p = packed[vertex];
+		float* v = &vertices[vertex * 8];
+		for (int i = 0; i < 3; ++i) v[i] = unpackRange(p.position[i], bounds.positionMin[i], bounds.positionMax[i]);
+		for (int i = 0; i < 2; ++i) v[3 + i] = unpackUnorm(p.uv[i], bounds.uvMin[i], bounds.uvMax[i]);
+		if (p.position[3] != 0) {
+			decodeOctahedral(p.normal, &v[5]);
+		}
+		else {
+			// Zero normals (OBJ without vn) stay zero
+			v[5] = v[6] = v[7] = 0;
+		}
+	}
+}
+
+void packIndices(const int* indices, int numIndices, u16* packed) {
+	for (int i = 0; i < numIndices; ++i) packed[i] = (u16)indices[i];
+}
+
+void unpackIndices(const u16* packed, int numIndices, int* indices) {
+	for (int i = 0; i < numIndices; ++i) indices[i] = packed[i];
+}
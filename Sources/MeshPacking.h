@@ -0,0 +1,35 @@
+#pragma once
+
+// Compact mesh encoding, half the size of the 8 float vertices and 32 bit indices:
+// snorm16 positions relative to the mesh bounds, unorm16 uvs relative to the uv range,
+// octahedral snorm16 normals and 16 bit indices for meshes with fewer than 65536 vertices.
+struct PackedVertex {
+	Kore::s16 position[4]; // w is 1 if the vertex has a normal
+	Kore::u16 uv[2];
+	Kore::s16 normal[2];
+};
+
+struct PackedMeshBounds {
+	float positionMin[3];
+	float positionMax[3];
+	float uvMin[2];
+	float uvMax[2];
+};
+
+const int maxShortIndexVertices = 65536;
+
+inline bool fitsShortIndices(int numVertices) {
+	return numVertices < maxShortIndexVertices;
+}
+
+// Bytes taken by a mesh in the float layout and packed
+int unpackedMeshSize(int numVertices, int numIndices);
+int packedMeshSize(int numVertices, int numIndices);
+
+// vertices are in the 8 float position/uv/normal layout
+void computePackedMeshBounds(const float* vertices, int numVertices, PackedMeshBounds& bounds);
+void packVertices(const float* vertices, int numVertices, const PackedMeshBounds& bounds, PackedVertex* packed);
+void unpackVertices(const PackedVertex* packed, int numVertices, const PackedMeshBounds& bounds, float* vertices);
+
+void packIndices(const int* indices, int numIndices, Kore::u16* packed);
+void unpackIndices(const Kore::u16* packed, int numIndices, int* indices);
@@ -0,0 +1,278 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+#include "ObjLoader.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+using namespace Kore;
+
+namespace {
+	// Every level keeps about this share of the triangles of the level before
+	const float lodReduction = 0.5f;
+	// A level which would keep more than this share of the level before is not worth its index buffer
+	const float minLodReduction = 0.9f;
+
+	// Symmetric 4x4 matrix of the summed squared distances to a set of planes
+	struct Quadric {
+		double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+
+		Quadric() : xx(0), xy(0), xz(0), xw(0), yy(0), yz(0), yw(0), zz(0), zw(0), ww(0) {}
+
+		// Plane ax + by + cz + d = 0 with a unit normal
+		void addPlane(double a, double b, double c, double d) {
+			xx += a * a; xy += a * b; xz += a * c; xw += a * d;
+			yy += b * b; yz += b * c; yw += b * d;
+			zz += c * c; zw += c * d;
+			ww += d * d;
+		}
+
+		void add(const Quadric& other) {
+			xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+			yy += other.yy; yz += other.yz; yw += other.yw;
+			zz += other.zz; zw += other.zw;
+			ww += other.ww;
+		}
+
+		double error(const float* p) const {
+			double x = p[0], y = p[1], z = p[2];
+			double e = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x
+				+ yy * y * y + 2 * yz * y * z + 2 * yw * y
+				+ zz * z * z + 2 * zw * z + ww;
+			return e > 0.0 ? e : 0.0;
+		}
+	};
+
+	// Collapse of vertex into target, outdated once vertex's stamp changed
+	struct Collapse {
+		double cost;
+		int vertex;
+		int target;
+		u32 stamp;
+
+		bool operator<(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	void cross(const float* a, const float* b, const float* c, double* normal) {
+		double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		normal[0] = u[1] * v[2] - u[2] * v[1];
+		normal[1] = u[2] * v[0] - u[0] * v[2];
+		normal[2] = u[0] * v[1] - u[1] * v[0];
+	}
+
+	class Simplifier {
+	public:
+		Simplifier(const Mesh& mesh) : positions(mesh.vertices), numVertices(mesh.numVertices), indices(mesh.indices, mesh.indices + mesh.numFaces * 3),
+			removed(mesh.numFaces, false), liveTriangles(mesh.numFaces), vertexTriangles(mesh.numVertices), quadrics(mesh.numVertices),
+			locked(mesh.numVertices, false), alive(mesh.numVertices, true), stamps(mesh.numVertices, 0), maxCost(0) {
+			for (int triangle = 0; triangle < mesh.numFaces; ++triangle) {
+				for (int corner = 0; corner < 3; ++corner) vertexTriangles[indices[triangle * 3 + corner]].push_back(triangle);
+				addTrianglePlane(triangle);
+			}
+			lockSeams();
+			lockBorders();
+			for (int vertex = 0; vertex < numVertices; ++vertex) pushCollapse(vertex);
+		}
+
+		// Collapses edges until at most targetTriangles are left, false if nothing more can be collapsed
+		bool simplify(int targetTriangles) {
+			while (liveTriangles > targetTriangles) {
+				if (collapses.empty()) return false;
+				Collapse collapse = collapses.top();
+				collapses.pop();
+				if (!alive[collapse.vertex] || !alive[collapse.target] || stamps[collapse.vertex] != collapse.stamp) continue;
+				apply(collapse);
+			}
+			return true;
+		}
+
+		int triangles() const { return liveTriangles; }
+
+		float error() const { return (float)std::sqrt(maxCost); }
+
+		void copyIndices(std::vector<int>& target) const {
+			target.clear();
+			target.reserve(liveTriangles * 3);
+			for (size_t triangle = 0; triangle < removed.size(); ++triangle) {
+				if (removed[triangle]) continue;
+				target.insert(target.end(), &indices[triangle * 3], &indices[triangle * 3] + 3);
+			}
+		}
+
+	private:
+		const float* position(int vertex) const { return &positions[vertex * 8]; }
+
+		void addTrianglePlane(int triangle) {
+			const int* corners = &indices[triangle * 3];
+			double normal[3];
+			cross(position(corners[0]), position(corners[1]), position(corners[2]), normal);
+			double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (length <= 0.0) return;
+			for (int i = 0; i < 3; ++i) normal[i] /= length;
+			const float* p = position(corners[0]);
+			double d = -(normal[0] * p[0] + normal[1] * p[1] + normal[2] * p[2]);
+			for (int corner = 0; corner < 3; ++corner) quadrics[corners[corner]].addPlane(normal[0], normal[1], normal[2], d);
+		}
+
+		// Vertices sharing their position with others sit on a uv or normal seam
+		void lockSeams() {
+			std::vector<int> order(numVertices);
+			for (int i = 0; i < numVertices; ++i) order[i] = i;
+			std::sort(order.begin(), order.end(), [this](int a, int b) {
+				return std::lexicographical_compare(position(a), position(a) + 3, position(b), position(b) + 3);
+			});
+			for (int i = 1; i < numVertices; ++i) {
+				if (std::equal(position(order[i]), position(order[i]) + 3, position(order[i - 1]))) {
+					locked[order[i]] = true;
+					locked[order[i - 1]] = true;
+				}
+			}
+		}
+
+		// Edges used by one triangle only
+		void lockBorders() {
+			std::vector<u64> edges;
+			edges.reserve(indices.size());
+			for (size_t triangle = 0; triangle < removed.size(); ++triangle) {
+				for (int corner = 0; corner < 3; ++corner) {
+					u32 a = (u32)indices[triangle * 3 + corner];
+					u32 b = (u32)indices[triangle * 3 + (corner + 1) % 3];
+					edges.push_back(a < b ? (u64)a << 32 | b : (u64)b << 32 | a);
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			for (size_t i = 0; i < edges.size();) {
+				size_t end = i + 1;
+				while (end < edges.size() && edges[end] == edges[i]) ++end;
+				if (end - i == 1) {
+					locked[(int)(edges[i] >> 32)] = true;
+					locked[(int)(edges[i] & 0xffffffff)] = true;
+				}
+				i = end;
+			}
+		}
+
+		// Moving vertex onto target must not turn any of its other triangles around
+		bool flips(int vertex, int target) const {
+			const std::vector<int>& triangles = vertexTriangles[vertex];
+			for (size_t i = 0; i < triangles.size(); ++i) {
+				if (removed[triangles[i]]) continue;
+				const int* corners = &indices[triangles[i] * 3];
+				if (corners[0] == target || corners[1] == target || corners[2] == target) continue;
+				const float* before[3];
+				const float* after[3];
+				for (int corner = 0; corner < 3; ++corner) {
+					before[corner] = position(corners[corner]);
+					after[corner] = corners[corner] == vertex ? position(target) : before[corner];
+				}
+				double oldNormal[3], newNormal[3];
+				cross(before[0], before[1], before[2], oldNormal);
+				cross(after[0], after[1], after[2], newNormal);
+				if (oldNormal[0] * newNormal[0] + oldNormal[1] * newNormal[1] + oldNormal[2] * newNormal[2] <= 0.0) return true;
+			}
+			return false;
+		}
+
+		// Queues the cheapest collapse of vertex into one of its neighbours
+		void pushCollapse(int vertex) {
+			if (locked[vertex] || !alive[vertex]) return;
+			Collapse best;
+			best.cost = -1.0;
+			const std::vector<int>& triangles = vertexTriangles[vertex];
+			for (size_t i = 0; i < triangles.size(); ++i) {
+				if (removed[triangles[i]]) continue;
+				for (int corner = 0; corner < 3; ++corner) {
+					int target = indices[triangles[i] * 3 + corner];
+					if (target == vertex) continue;
+					Quadric quadric = quadrics[vertex];
+					quadric.add(quadrics[target]);
+					double cost = quadric.error(position(target));
+					if ((best.cost < 0.0 || cost < best.cost) && !flips(vertex, target)) {
+						best.cost = cost;
+						best.target = target;
+					}
+				}
+			}
+			if (best.cost < 0.0) return;
+			best.vertex = vertex;
+			best.stamp = stamps[vertex];
+			collapses.push(best);
+		}
+
+		void apply(const Collapse& collapse) {
+			const int vertex = collapse.vertex;
+			const int target = collapse.target;
+			maxCost = std::max(maxCost, collapse.cost);
+
+			std::vector<int>& triangles = vertexTriangles[vertex];
+			std::vector<int>& targetTriangles = vertexTriangles[target];
+			for (size_t i = 0; i < triangles.size(); ++i) {
+				int triangle = triangles[i];
+				if (removed[triangle]) continue;
+				int* corners = &indices[triangle * 3];
+				bool degenerate = corners[0] == target || corners[1] == target || corners[2] == target;
+				for (int corner = 0; corner < 3; ++corner) {
+					if (corners[corner] == vertex) corners[corner] = target;
+				}
+				if (degenerate) {
+					removed[triangle] = true;
+					--liveTriangles;
+				}
+				else {
+					targetTriangles.push_back(triangle);
+				}
+			}
+			alive[vertex] = false;
+			quadrics[target].add(quadrics[vertex]);
+
+			// Everything around the collapsed vertex needs new candidates, its triangles now all belong to target
+			std::vector<int> neighbours;
+			for (size_t i = 0; i < triangles.size(); ++i) {
+				for (int corner = 0; corner < 3; ++corner) neighbours.push_back(indices[triangles[i] * 3 + corner]);
+			}
+			std::vector<int>().swap(triangles);
+			targetTriangles.erase(std::remove_if(targetTriangles.begin(), targetTriangles.end(), [this](int triangle) { return removed[triangle]; }), targetTriangles.end());
+			for (size_t i = 0; i < targetTriangles.size(); ++i) {
+				for (int corner = 0; corner < 3; ++corner) neighbours.push_back(indices[targetTriangles[i] * 3 + corner]);
+			}
+			std::sort(neighbours.begin(), neighbours.end());
+			neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+			for (size_t i = 0; i < neighbours.size(); ++i) {
+				++stamps[neighbours[i]];
+				pushCollapse(neighbours[i]);
+			}
+		}
+
+		const float* positions;
+		const int numVertices;
+		std::vector<int> indices;
+		std::vector<bool> removed; // per triangle
+		int liveTriangles;
+		std::vector<std::vector<int> > vertexTriangles;
+		std::vector<Quadric> quadrics;
+		std::vector<bool> locked;
+		std::vector<bool> alive;
+		std::vector<u32> stamps;
+		std::priority_queue<Collapse> collapses;
+		double maxCost;
+	};
+}
+
+void buildMeshLods(const Mesh& mesh, int levels, std::vector<MeshLod>& lods) {
+	lods.clear();
+	if (mesh.numFaces < minLodTriangles) return;
+
+	Simplifier simplifier(mesh);
+	int triangles = mesh.numFaces;
+	for (int level = 0; level < levels; ++level) {
+		bool reachedTarget = simplifier.simplify((int)(triangles * lodReduction));
+		if (simplifier.triangles() > triangles * minLodReduction) break;
+
+		triangles = simplifier.triangles();
+		lods.push_back(MeshLod());
+		simplifier.copyIndices(lods.back().indices);
+		lods.back().error = simplifier.error();
+		if (!reachedTarget) break;
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+struct Mesh;
+
+// A simplified index list of a mesh, it uses the mesh's own vertices
+struct MeshLod {
+	std::vector<int> indices;
+	float error; // how far the surface may be off, in the units of the vertex positions
+};
+
+// Meshes with fewer triangles are not worth simplifying
+const int minLodTriangles = 512;
+
+// Builds up to levels simplified index lists, each with about half the triangles of the one
+// before. Edges are collapsed in order of their quadric error (Garland and Heckbert), always
+// onto one of their two vertices so every level can share the original vertex buffer.
+// Vertices on uv/normal seams and on open borders are never moved, which keeps seams closed
+// and outlines in place, and collapses which would flip a triangle are skipped. Fewer levels
+// are returned when the mesh cannot be simplified any further.
+void buildMeshLods(const Mesh& mesh, int levels, std::vector<MeshLod>& lods);
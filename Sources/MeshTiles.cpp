@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "MeshTiles.h"
+#include "ObjLoader.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_TILES_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	const int lanes = 4;
+
+	enum Bound { MinX, MinY, MinZ, MaxX, MaxY, MaxZ };
+
+	// Frustum planes in the space worldViewProjection transforms from (Gribb and Hartmann),
+	// ax + by + cz + d >= 0 inside. The near plane is the one of -w <= z, which also holds
+	// for projections to 0 <= z.
+	void extractPlanes(const mat4& m, float planes[6][4]) {
+		for (int i = 0; i < 3; ++i) {
+			for (int column = 0; column < 4; ++column) {
+				planes[i * 2][column] = m.get(3, column) + m.get(i, column);
+				planes[i * 2 + 1][column] = m.get(3, column) - m.get(i, column);
+			}
+		}
+	}
+}
+
+MeshTiles::MeshTiles(Mesh& mesh, int tilesPerSide) : numTiles(tilesPerSide * tilesPerSide), starts(numTiles), counts(numTiles, 0) {
+	const int numTriangles = mesh.numFaces;
+	const float* vertices = mesh.vertices;
+
+	// The two widest axes span the grid
+	float low[3] = { 0, 0, 0 }, high[3] = { 0, 0, 0 };
+	for (int i = 0; i < mesh.numVertices; ++i) {
+		for (int axis = 0; axis < 3; ++axis) {
+			float value = vertices[i * 8 + axis];
+			if (i == 0 || value < low[axis]) low[axis] = value;
+			if (i == 0 || value > high[axis]) high[axis] = value;
+		}
+	}
+	int up = 0;
+	for (int axis = 1; axis < 3; ++axis) {
+		if (high[axis] - low[axis] < high[up] - low[up]) up = axis;
+	}
+	const int u = up == 0 ? 1 : 0;
+	const int v = up == 2 ? 1 : 2;
+
+	// Tile of every triangle by its centroid
+	std::vector<int> tiles(numTriangles);
+	for (int triangle = 0; triangle < numTriangles; ++triangle) {
+		float center[3] = { 0, 0, 0 };
+		for (int corner = 0; corner < 3; ++corner) {
+			const float* position = &vertices[mesh.indices[triangle * 3 + corner] * 8];
+			for (int axis = 0; axis < 3; ++axis) center[axis] += position[axis] / 3.0f;
+		}
+		int column = high[u] > low[u] ? (int)((center[u] - low[u]) / (high[u] - low[u]) * tilesPerSide) : 0;
+		int row = high[v] > low[v] ? (int)((center[v] - low[v]) / (high[v] - low[v]) * tilesPerSide) : 0;
+		column = std::max(0, std::min(tilesPerSide - 1, column));
+		row = std::max(0, std::min(tilesPerSide - 1, row));
+		tiles[triangle] = row * tilesPerSide + column;
+		++counts[tiles[triangle]];
+	}
+
+	// Counting sort of the triangles, stable so the order of a vertex cache optimization survives within a tile
+	int offset = 0;
+	for (int tile = 0; tile < numTiles; ++tile) {
+		starts[tile] = offset;
+		offset += counts[tile] * 3;
+		counts[tile] *= 3;
+	}
+	std::vector<int> next(starts);
+	std::vector<int> sorted(numTriangles * 3);
+	for (int triangle = 0; triangle < numTriangles; ++triangle) {
+		int& target = next[tiles[triangle]];
+		for (int corner = 0; corner < 3; ++corner) sorted[target++] = mesh.indices[triangle * 3 + corner];
+	}
+	std::copy(sorted.begin(), sorted.end(), mesh.indices);
+
+	// Boxes of the tiles, empty tiles get an inverted box no plane test passes
+	const int padded = (numTiles + lanes - 1) / lanes * lanes;
+	for (int i = 0; i < 3; ++i) {
+		bounds[MinX + i].assign(padded, 1e30f);
+		bounds[MaxX + i].assign(padded, -1e30f);
+	}
+	for (int tile = 0; tile < numTiles; ++tile) {
+		for (int i = starts[tile]; i < starts[tile] + counts[tile]; ++i) {
+			const float* position = &vertices[mesh.indices[i] * 8];
+			for (int axis = 0; axis < 3; ++axis) {
+				bounds[MinX + axis][tile] = std::min(bounds[MinX + axis][tile], position[axis]);
+				bounds[MaxX + axis][tile] = std::max(bounds[MaxX + axis][tile], position[axis]);
+			}
+		}
+	}
+}
+
+int MeshTiles::cull(const mat4& worldViewProjection, int* visible) const {
+	float planes[6][4];
+	extractPlanes(worldViewProjection, planes);
+
+	// A box is outside if its corner furthest along a plane's normal is behind the plane.
+	// That corner only depends on the signs of the normal, so one choice serves all tiles.
+	const float* corners[6][3];
+	for (int plane = 0; plane < 6; ++plane) {
+		for (int axis = 0; axis < 3; ++axis) {
+			corners[plane][axis] = planes[plane][axis] >= 0.0f ? bounds[MaxX + axis].data() : bounds[MinX + axis].data();
+		}
+	}
+
+	int count = 0;
+	for (int first = 0; first < numTiles; first += lanes) {
+#ifdef MESH_TILES_SSE2
+		__m128 outside = _mm_setzero_ps();
+		for (int plane = 0; plane < 6; ++plane) {
+			__m128 distance = _mm_set1_ps(planes[plane][3]);
+			for (int axis = 0; axis < 3; ++axis) {
+				distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(planes[plane][axis]), _mm_loadu_ps(corners[plane][axis] + first)));
+			}
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+		}
+		int outsideMask = _mm_movemask_ps(outside);
+		for (int lane = 0; lane < lanes && first + lane < numTiles; ++lane) {
+			if ((outsideMask & (1 << lane)) == 0) visible[count++] = first + lane;
+		}
+#else
+		for (int tile = first; tile < first + lanes && tile < numTiles; ++tile) {
+			bool outside = false;
+			for (int plane = 0; plane < 6 && !outside; ++plane) {
+				float distance = planes[plane][3];
+				for (int axis = 0; axis < 3; ++axis) distance += planes[plane][axis] * corners[plane][axis][tile];
+				outside = distance < 0.0f;
+			}
+			if (!outside) visible[count++] = tile;
+		}
+#endif
+	}
+	return count;
+}
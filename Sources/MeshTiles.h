@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Kore/Graphics3/Graphics.h>
+#include <vector>
+
+struct Mesh;
+
+// Splits a large, flat mesh such as a terrain into a grid of tiles so only the ones in view are
+// drawn. The triangles are sorted by tile in the mesh's own index list, so every tile is one
+// range of the index buffer, and each tile keeps the bounding box of its triangles. Culling
+// tests the boxes against the frustum planes four tiles at a time.
+class MeshTiles {
+public:
+	// Sorts the triangles of mesh into tilesPerSide x tilesPerSide tiles over its two widest axes,
+	// keeping their order within a tile
+	MeshTiles(Mesh& mesh, int tilesPerSide);
+
+	int count() const { return numTiles; }
+	int start(int tile) const { return starts[tile]; } // first index
+	int indexCount(int tile) const { return counts[tile]; }
+
+	// Writes the tiles whose boxes are at least partly inside the frustum of worldViewProjection
+	// (projection * view * world) into visible, in index buffer order, and returns their number
+	int cull(const Kore::mat4& worldViewProjection, int* visible) const;
+
+private:
+	int numTiles;
+	std::vector<int> starts;
+	std::vector<int> counts;
+	// Box corners, one array per coordinate padded to whole SIMD vectors
+	std::vector<float> bounds[6]; // minX, minY, minZ, maxX, maxY, maxZ
+};
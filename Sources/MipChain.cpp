@@ -0,0 +1,82 @@
+#include "pch.h"
+#include "MipChain.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIP_CHAIN_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	// Rows of a level per task, smaller levels are filtered by the calling thread
+	const int rowsPerTask = 64;
+
+	void downsampleTexel(const u8* row0, const u8* row1, int sourceWidth, int x, u8* target) {
+		int x0 = std::min(x * 2, sourceWidth - 1);
+		int x1 = std::min(x * 2 + 1, sourceWidth - 1);
+		for (int channel = 0; channel < 4; ++channel) {
+			target[channel] = (u8)((row0[x0 * 4 + channel] + row0[x1 * 4 + channel] + row1[x0 * 4 + channel] + row1[x1 * 4 + channel] + 2) >> 2);
+		}
+	}
+}
+
+int mipLevelCount(int width, int height) {
+	int levels = 1;
+	while ((width >> levels) > 0 || (height >> levels) > 0) ++levels;
+	return levels;
+}
+
+void downsampleBox(const u8* source, int sourceWidth, int sourceHeight, u8* target, int width, int firstRow, int endRow) {
+	for (int y = firstRow; y < endRow; ++y) {
+		const u8* row0 = &source[std::min(y * 2, sourceHeight - 1) * sourceWidth * 4];
+		const u8* row1 = &source[std::min(y * 2 + 1, sourceHeight - 1) * sourceWidth * 4];
+		u8* targetRow = &target[y * width * 4];
+		int x = 0;
+#ifdef MIP_CHAIN_SSE2
+		// Two target texels from four source texels of both rows, as long as they are all inside
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rounding = _mm_set1_epi16(2);
+		for (; x + 2 <= sourceWidth / 2; x += 2) {
+			__m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row0[x * 8]));
+			__m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row1[x * 8]));
+			__m128i low = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero)); // texels 0, 1
+			__m128i high = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero)); // texels 2, 3
+			__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high)); // 0 + 1, 2 + 3
+			__m128i mean = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(&targetRow[x * 4]), _mm_packus_epi16(mean, zero));
+		}
+#endif
+		for (; x < width; ++x) downsampleTexel(row0, row1, sourceWidth, x, &targetRow[x * 4]);
+	}
+}
+
+MipChain::MipChain() : baseWidth(0), baseHeight(0), numLevels(0) {}
+
+void MipChain::build(const u8* source, int width, int height) {
+	baseWidth = width;
+	baseHeight = height;
+	numLevels = std::min(mipLevelCount(width, height), maxMipLevels);
+	int size = 0;
+	for (int level = 0; level < numLevels; ++level) {
+		offsets[level] = size;
+		size += this->width(level) * this->height(level) * 4;
+	}
+	texels.resize(size);
+	memcpy(texels.data(), source, width * height * 4);
+
+	for (int level = 1; level < numLevels; ++level) {
+		const u8* previous = &texels[offsets[level - 1]];
+		const int previousWidth = this->width(level - 1);
+		const int previousHeight = this->height(level - 1);
+		u8* target = &texels[offsets[level]];
+		const int levelWidth = this->width(level);
+		const int levelHeight = this->height(level);
+		parallelFor(levelHeight, rowsPerTask, [=](int begin, int end) {
+			downsampleBox(previous, previousWidth, previousHeight, target, levelWidth, begin, end);
+		}, "Filter mip level");
+	}
+}
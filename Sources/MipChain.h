@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+// Enough levels for 32768 texels on a side
+const int maxMipLevels = 16;
+
+// Levels down to 1x1
+int mipLevelCount(int width, int height);
+
+// Width or height of a level
+inline int mipLevelSize(int size, int level) {
+	int result = size >> level;
+	return result > 0 ? result : 1;
+}
+
+// The full mip chain of an RGBA32 image in one array, level 0 first, every level with tightly
+// packed rows. Each level is the 2x2 box filtered level before (SSE2 where available), large
+// levels are split into row ranges which run as tasks (see JobSystem.h). Building it on a
+// worker thread leaves the render thread only the upload.
+class MipChain {
+public:
+	MipChain();
+
+	// Copies level 0 from texels and filters the others
+	void build(const Kore::u8* texels, int width, int height);
+
+	int levels() const { return numLevels; }
+	int width(int level) const { return mipLevelSize(baseWidth, level); }
+	int height(int level) const { return mipLevelSize(baseHeight, level); }
+
+	// width(level) * height(level) RGBA32 texels
+	const Kore::u8* levelData(int level) const { return &texels[offsets[level]]; }
+
+	int sizeInBytes() const { return (int)texels.size(); }
+
+private:
+	std::vector<Kore::u8> texels;
+	int offsets[maxMipLevels];
+	int baseWidth;
+	int baseHeight;
+	int numLevels;
+};
+
+// Rows [firstRow, endRow) of the next level of an RGBA32 image, width and height are the
+// target's. Every texel is the rounded mean of 2x2 source texels, clamped at odd edges.
+void downsampleBox(const Kore::u8* source, int sourceWidth, int sourceHeight, Kore::u8* target, int width, int firstRow, int endRow);
@@ -0,0 +1,182 @@
+#include "pch.h"
+#include "NumberParser.h"
+#include <cstring>
+#include <locale>
+#include <sstream>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NUMBER_PARSER_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+using namespace Kore;
+
+namespace {
+	// Every power of ten up to 1e22 is exact in a double
+	const double powersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const int maxFastExponent = 22;
+	const int maxMantissaDigits = 19;
+	const u64 maxExactMantissa = 1ull << 53;
+
+	bool isDigit(char c) {
+		return (unsigned char)(c - '0') < 10;
+	}
+
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+#ifdef NUMBER_PARSER_SSE2
+	int countTrailingZeros(unsigned value) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return (int)index;
+#else
+		return __builtin_ctz(value);
+#endif
+	}
+
+	// Eight ASCII digits to their value in three multiplications
+	u32 parseEightDigits(const char* p) {
+		u64 value;
+		memcpy(&value, p, 8);
+		value = ((value & 0x0F0F0F0F0F0F0F0Full) * 2561) >> 8;
+		value = ((value & 0x00FF00FF00FF00FFull) * 6553601) >> 16;
+		return (u32)(((value & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32);
+	}
+#endif
+
+	// Length of the run of digits starting at p, checks 16 characters at a time where possible
+	int countDigits(const char* p, const char* end) {
+		const char* start = p;
+#ifdef NUMBER_PARSER_SSE2
+		const __m128i zero = _mm_set1_epi8('0');
+		const __m128i bias = _mm_set1_epi8((char)0x80);
+		const __m128i limit = _mm_set1_epi8((char)(10 - 128));
+		while (end - p >= 16) {
+			__m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			// unsigned (c - '0') < 10 as a signed comparison
+			__m128i digits = _mm_cmplt_epi8(_mm_xor_si128(_mm_sub_epi8(chars, zero), bias), limit);
+			unsigned mask = (unsigned)_mm_movemask_epi8(digits);
+			if (mask != 0xffff) return (int)(p - start) + countTrailingZeros(~mask);
+			p += 16;
+		}
+#endif
+		while (p < end && isDigit(*p)) ++p;
+		return (int)(p - start);
+	}
+
+	u64 accumulateDigits(u64 value, const char* p, int count) {
+#ifdef NUMBER_PARSER_SSE2
+		while (count >= 8) {
+			value = value * 100000000 + parseEightDigits(p);
+			p += 8;
+			count -= 8;
+		}
+#endif
+		for (int i = 0; i < count; ++i) {
+			value = value * 10 + (u64)(p[i] - '0');
+		}
+		return value;
+	}
+
+	// Rare shapes (long mantissas, huge exponents) go through the standard library in the classic locale
+	const char* parseFloatSlow(const char* p, const char* end, float& value) {
+		const char* tokenEnd = p;
+		while (tokenEnd < end && !isSpace(*tokenEnd) && *tokenEnd != '/') ++tokenEnd;
+		std::istringstream stream(std::string(p, tokenEnd));
+		stream.imbue(std::locale::classic());
+		double result;
+		stream >> result;
+		if (stream.fail()) return p;
+		value = (float)result;
+		return stream.eof() ? tokenEnd : p + (int)stream.tellg();
+	}
+}
+
+const char* parseFloat(const char* p, const char* end, float& value) {
+	const char* s = p;
+	bool negative = false;
+	if (s < end && (*s == '-' || *s == '+')) {
+		negative = *s == '-';
+		++s;
+	}
+
+	const char* integer = s;
+	int integerDigits = countDigits(s, end);
+	s += integerDigits;
+
+	const char* fraction = s;
+	int fractionDigits = 0;
+	if (s < end && *s == '.') {
+		fraction = ++s;
+		fractionDigits = countDigits(s, end);
+		s += fractionDigits;
+	}
+
+	if (integerDigits + fractionDigits == 0 || integerDigits + fractionDigits > maxMantissaDigits) return parseFloatSlow(p, end, value);
+	if (s < end && (*s == 'x' || *s == 'X')) return parseFloatSlow(p, end, value);
+
+	int exponent = 0;
+	if (s < end && (*s == 'e' || *s == 'E')) {
+		const char* e = s + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			negativeExponent = *e == '-';
+			++e;
+		}
+		int exponentDigits = countDigits(e, end);
+		if (exponentDigits > 4) return parseFloatSlow(p, end, value);
+		if (exponentDigits > 0) {
+			exponent = (int)accumulateDigits(0, e, exponentDigits);
+			if (negativeExponent) exponent = -exponent;
+			s = e + exponentDigits;
+		}
+	}
+
+	u64 mantissa = accumulateDigits(accumulateDigits(0, integer, integerDigits), fraction, fractionDigits);
+	exponent -= fractionDigits;
+
+	// Clinger's fast path: both operands are exact doubles, so the one rounding matches strtod
+	if (mantissa > maxExactMantissa || exponent < -maxFastExponent || exponent > maxFastExponent) return parseFloatSlow(p, end, value);
+	double result = (double)mantissa;
+	result = exponent < 0 ? result / powersOfTen[-exponent] : result * powersOfTen[exponent];
+	value = (float)(negative ? -result : result);
+	return s;
+}
+
+const char* parseInt(const char* p, const char* end, int& value) {
+	const char* s = p;
+	bool negative = s < end && *s == '-';
+	if (s < end && (*s == '-' || *s == '+')) ++s;
+
+	int digits = countDigits(s, end);
+	if (digits == 0) return p;
+
+	u64 result = accumulateDigits(0, s, digits < 10 ? digits : 10);
+	if (result > 0x7fffffff) result = 0x7fffffff;
+	value = negative ? -(int)result : (int)result;
+	return s + digits;
+}
+
+const char* parseIndexTriple(const char* p, const char* end, int indices[3]) {
+	indices[0] = indices[1] = indices[2] = 0;
+	const char* s = parseInt(p, end, indices[0]);
+	if (s == p) return p;
+	if (s < end && *s == '/') {
+		// an empty entry in "v//vn" leaves the uv at 0
+		s = parseInt(s + 1, end, indices[1]);
+		if (s < end && *s == '/') {
+			s = parseInt(s + 1, end, indices[2]);
+		}
+	}
+	return s;
+}
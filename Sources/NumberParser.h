@@ -0,0 +1,17 @@
+#pragma once
+
+// Locale independent number parsing for the asset loaders.
+// None of the parsers read at or beyond end, so they work directly on file mappings.
+// Each returns the position after the parsed number, or p itself if there is no number.
+
+// Gives the same result as (float)strtod in the "C" locale. Plain decimals like "-0.543539" or
+// "1.5e-3" take a fast path which is exact, long mantissas and large exponents fall back to
+// the standard library. Hexadecimal floats, inf and nan are not supported.
+const char* parseFloat(const char* p, const char* end, float& value);
+
+// Decimal integer with optional sign
+const char* parseInt(const char* p, const char* end, int& value);
+
+// OBJ face corner "v", "v/vt", "v//vn" or "v/vt/vn". Missing entries are set to 0,
+// which is never a valid OBJ index.
+const char* parseIndexTriple(const char* p, const char* end, int indices[3]);
@@ -1,251 +1,515 @@
 #include "pch.h"
 #include "ObjLoader.h"
-#include <Kore/IO/FileReader.h>
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include "NumberParser.h"
+#include "ScratchArena.h"
+#include <Kore/System.h>
+#include <algorithm>
+#include <atomic>
 #include <cstring>
-#include <cstdlib>
+#include <utility>
+#include <vector>
 
 using namespace Kore;
 
 namespace {
-	char* tokenize(char* s, char delimiter, int& i) {
-		int lastIndex = i;
-		char* index = strchr(s + lastIndex + 1, delimiter);
-		if (index == nullptr) {
-			return nullptr;
+	// Array that grows geometrically while parsing so the file only has to be scanned once.
+	// It lives in a scratch arena, the storage it outgrows is only freed with the arena.
+	template<typename T>
+	struct GrowableArray {
+		GrowableArray() : data(nullptr), count(0), capacity(0) {}
+
+		T* grow(ScratchArena& arena, int n) {
+			if (count + n > capacity) {
+				int newCapacity = capacity < 256 ? 256 : capacity * 2;
+				while (newCapacity < count + n) newCapacity *= 2;
+				T* newData = arena.allocate<T>(newCapacity);
+				if (count > 0) memcpy(newData, data, count * sizeof(T));
+				data = newData;
+				capacity = newCapacity;
+			}
+			T* result = data + count;
+			count += n;
+			return result;
+		}
+
+		void clear() {
+			data = nullptr;
+			count = capacity = 0;
 		}
-		int newIndex = (int)(index - s);
-		i = newIndex;
-		int length = newIndex - lastIndex;
-		char* token = new char[length + 1];
-		strncpy(token, s + lastIndex + 1, length);
-		token[length] = 0;
-		return token;
-	}
 
-	int countFirstCharLines(char* source, const char* start) {
-		int count = 0;
+		T* data;
+		int count;
+		int capacity;
+	};
+
+	// Chunks smaller than this are not worth a task
+	const int minChunkSize = 256 * 1024;
+
+	// Output of one newline aligned piece of the file. Indices which are relative to
+	// the end of the chunk's data (negative OBJ indices) are fixed up during the merge.
+	struct ObjChunk {
+		// Of the task which parses the chunk, holds the arrays below
+		ScratchArena arena;
+
+		const char* begin;
+		const char* end;
+		int lines;
+
+		GrowableArray<float> positions;
+		GrowableArray<float> uvs;
+		GrowableArray<float> normals;
+
+		// position/uv/normal triple of every triangle corner, -1 where the corner has no uv or normal
+		GrowableArray<int> corners;
+
+		// Positions in corners which still need the global offset added
+		GrowableArray<int> relativeCorners;
+
+		int positionOffset;
+		int uvOffset;
+		int normalOffset;
+		int cornerOffset;
+
+		// Frees the arrays but keeps the arena's memory for the next load
+		void clear() {
+			positions.clear();
+			uvs.clear();
+			normals.clear();
+			corners.clear();
+			relativeCorners.clear();
+			arena.reset();
+		}
+	};
 
-		int index = 0;
-		char* line = tokenize(source, '\n', index);
+	// Chunks of the loads on this thread, kept so the next load reuses their arenas
+	class ChunkPool {
+	public:
+		ChunkPool() : chunks(nullptr), count(0) {}
 
-		while (line != nullptr) {
-			char *pch = strstr(line, start);
-			if (pch == line)
-				count++;
-			line = tokenize(source, '\n', index);
+		~ChunkPool() {
+			delete[] chunks;
 		}
-		return count;
-	}
 
-	int countFacesInLine(char* line) {
-		char* token = strtok(line, " ");
-		int i = -1;
-		while (token != nullptr) {
-			token = strtok(nullptr, " ");
-			i++;
+		ObjChunk* get(int n) {
+			if (n > count) {
+				delete[] chunks;
+				chunks = new ObjChunk[n];
+				count = n;
+			}
+			return chunks;
 		}
 
-		// For now, handle tris and quads
+	private:
+		ObjChunk* chunks;
+		int count;
+	};
+
+	thread_local ChunkPool chunkPool;
 
-		if (i == 3) {
-			return 1;
+	std::atomic<int> liveMeshBytes(0);
+	std::atomic<int> peakLiveMeshBytes(0);
+
+	void addMeshBytes(int bytes) {
+		int live = liveMeshBytes += bytes;
+		int peak = peakLiveMeshBytes;
+		while (live > peak && !peakLiveMeshBytes.compare_exchange_weak(peak, live)) {}
+	}
+
+	// Open addressing hash map from position/uv/normal triples to welded vertex indices
+	class VertexMap {
+	public:
+		// The map's arrays come from scratch
+		VertexMap(ScratchArena& scratch, int maxVertices) : count(0) {
+			mask = 1;
+			while (mask < (u32)maxVertices * 2) mask <<= 1;
+			slots = scratch.allocate<int>(mask);
+			for (u32 i = 0; i < mask; ++i) slots[i] = -1;
+			--mask;
+			keys = scratch.allocate<int>(maxVertices * 3);
 		}
-		else {
-			return 2;
+
+		// Index of the vertex for the triple, the next free index if it was not seen before
+		int insert(const int* key) {
+			u32 slot = hash(key) & mask;
+			for (;;) {
+				int vertex = slots[slot];
+				if (vertex < 0) {
+					slots[slot] = count;
+					keys[count * 3 + 0] = key[0];
+					keys[count * 3 + 1] = key[1];
+					keys[count * 3 + 2] = key[2];
+					return count++;
+				}
+				const int* other = &keys[vertex * 3];
+				if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2]) return vertex;
+				slot = (slot + 1) & mask;
+			}
 		}
-	}
 
-	int countFaces(char* source) {
-		int count = 0;
+		const int* key(int vertex) const {
+			return &keys[vertex * 3];
+		}
 
-		int index = 0;
-		char* line = tokenize(source, '\n', index);
+		int size() const {
+			return count;
+		}
 
-		while (line != nullptr) {
-			if (line[0] == 'f') {
-				count += countFacesInLine(line);
-			}
-			line = tokenize(source, '\n', index);
+	private:
+		static u32 hash(const int* key) {
+			u32 h = (u32)key[0] * 0x9E3779B1u ^ (u32)key[1] * 0x85EBCA77u ^ (u32)key[2] * 0xC2B2AE3Du;
+			h ^= h >> 15;
+			h *= 0x2C1B3C6Du;
+			h ^= h >> 13;
+			return h;
 		}
-		return count;
-	}
 
-	int countVertices(char* source) {
-		return countFirstCharLines(source, "v ");
+		int* slots;
+		int* keys;
+		u32 mask;
+		int count;
+	};
+
+	bool isSpace(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
 	}
 
-	int countNormals(char* source) {
-		return countFirstCharLines(source, "vn ");
+	// Moves p to the start of the next token on the line, returns false at the end of the line
+	bool nextToken(const char*& p, const char* lineEnd) {
+		while (p < lineEnd && isSpace(*p)) ++p;
+		return p < lineEnd;
 	}
 
-	int countUVs(char* source) {
-		return countFirstCharLines(source, "vt ");
+	void skipToken(const char*& p, const char* lineEnd) {
+		while (p < lineEnd && !isSpace(*p)) ++p;
 	}
 
-	void parseVertex(Mesh* mesh, char* line) {
-		char* token;
-		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			mesh->curVertex[i] = (float)strtod(token, nullptr);
+	void parseFloats(const char* p, const char* lineEnd, float* values, int count) {
+		for (int i = 0; i < count; ++i) {
+			values[i] = 0;
+			if (!nextToken(p, lineEnd)) continue;
+			p = parseFloat(p, lineEnd, values[i]);
+			skipToken(p, lineEnd);
 		}
+	}
 
-		mesh->curVertex += 3;
-		mesh->curVertex[0] = 0;
-		mesh->curVertex[1] = 0;
-		mesh->curVertex += 5;
+	// Converts a one based OBJ index into a zero based one, 0 (missing) becomes -1. Negative
+	// indices count back from the current end of the chunk's data and are marked as relative.
+	int resolveIndex(int index, int count, bool& relative) {
+		relative = index < 0;
+		return relative ? count + index : index - 1;
+	}
 
-		mesh->numVertices++;
+	void parseVertex(ObjChunk& chunk, const char* p, const char* lineEnd) {
+		parseFloats(p, lineEnd, chunk.positions.grow(chunk.arena, 3), 3);
 	}
 
-	void setUV(Mesh* mesh, int index, float u, float v) {
-		mesh->vertices[(index * 8) + 3] = u;
-		mesh->vertices[(index * 8) + 4] = v;
+	void parseUV(ObjChunk& chunk, const char* p, const char* lineEnd) {
+		parseFloats(p, lineEnd, chunk.uvs.grow(chunk.arena, 2), 2);
 	}
 
-	void setNormal(Mesh* mesh, int index, float x, float y, float z) {
-		mesh->vertices[(index * 8) + 5] = x;
-		mesh->vertices[(index * 8) + 6] = y;
-		mesh->vertices[(index * 8) + 7] = z;
+	void parseNormal(ObjChunk& chunk, const char* p, const char* lineEnd) {
+		parseFloats(p, lineEnd, chunk.normals.grow(chunk.arena, 3), 3);
 	}
 
-	void parseFace(Mesh* mesh, char* line) {
-		char* token;
-		int verts[4];
-		int uvIndex[4];
-		int normalIndex[4];
-		bool hasUV[4];
-		bool hasNormal[4];
-		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			char* endPtr;
-			verts[i] = (int)strtol(token, &endPtr, 0) - 1;
-			if (endPtr[0] == '/') {
-				// Parse the uv
-				hasUV[i] = true;
-				uvIndex[i] = (int)strtol(endPtr + 1, &endPtr, 0) - 1;
-			} else {
-				// There is no uv
-				hasUV[i] = false;
-				hasNormal[i] = false;
-			}
-			if (endPtr[0] == '/') {
-				hasNormal[i] = true;
-				normalIndex[i] = (int)strtol(endPtr + 1, nullptr, 0) - 1;
-			} 
-		}
-		token = strtok(nullptr, " ");
-		//char* result;
-		if (token != nullptr) {
-			verts[3] = (int)strtol(token, nullptr, 0) - 1;
+	void addCorner(ObjChunk& chunk, const int* triple, const bool* relative) {
+		int corner = chunk.corners.count;
+		int* attributes = chunk.corners.grow(chunk.arena, 3);
+		for (int i = 0; i < 3; ++i) {
+			attributes[i] = triple[i];
+			if (relative[i]) *chunk.relativeCorners.grow(chunk.arena, 1) = corner + i;
+		}
+	}
+
+	void parseFace(ObjChunk& chunk, const char* p, const char* lineEnd) {
+		int triples[4][3];
+		bool relative[4][3];
+
+		// For now, handle tris and quads
+		int corners = 0;
+		while (corners < 4 && nextToken(p, lineEnd)) {
+			int triple[3];
+			p = parseIndexTriple(p, lineEnd, triple);
+			triples[corners][0] = resolveIndex(triple[0], chunk.positions.count / 3, relative[corners][0]);
+			triples[corners][1] = resolveIndex(triple[1], chunk.uvs.count / 2, relative[corners][1]);
+			triples[corners][2] = resolveIndex(triple[2], chunk.normals.count / 3, relative[corners][2]);
+			skipToken(p, lineEnd);
+			++corners;
+		}
+
+		static const int quad[6] = { 0, 1, 2, 2, 3, 0 };
+		if (corners == 4) {
 			// We have a quad
-			mesh->curIndex[0] = verts[0];
-			mesh->curIndex[1] = verts[1];
-			mesh->curIndex[2] = verts[2];
-			mesh->curIndex += 3;
-			mesh->curIndex[0] = verts[2];
-			mesh->curIndex[1] = verts[3];
-			mesh->curIndex[2] = verts[0];
-			mesh->curIndex += 3;
-			mesh->numFaces += 2;
-		}
-		else {
+			for (int i = 0; i < 6; ++i) addCorner(chunk, triples[quad[i]], relative[quad[i]]);
+		}
+		else if (corners == 3) {
 			// We have a triangle
-			for (int i = 0; i < 3; i++) {
-				mesh->curIndex[i] = verts[i];
+			for (int i = 0; i < 3; ++i) addCorner(chunk, triples[i], relative[i]);
+		}
+	}
+
+	void parseLine(ObjChunk& chunk, const char* line, const char* lineEnd) {
+		const char* p = line;
+		if (!nextToken(p, lineEnd)) return;
 
-				if (!hasUV[i]) continue;
+		const char* keyword = p;
+		skipToken(p, lineEnd);
+		int length = (int)(p - keyword);
 
-				// Set the UVs
-				setUV(mesh, mesh->curIndex[i], mesh->uvs[uvIndex[i] * 2], mesh->uvs[(uvIndex[i] * 2) + 1]);
+		if (length == 1 && keyword[0] == 'v') {
+			// Read some vertex data
+			parseVertex(chunk, p, lineEnd);
+		}
+		else if (length == 1 && keyword[0] == 'f') {
+			// Read some face data
+			parseFace(chunk, p, lineEnd);
+		}
+		else if (length == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+			parseUV(chunk, p, lineEnd);
+		}
+		else if (length == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+			parseNormal(chunk, p, lineEnd);
+		}
 
-				if (!hasNormal[i]) continue;
+		// Ignore all other commands (for now)
+	}
 
-				// Set the Normal
-				setNormal(mesh, mesh->curIndex[i], mesh->normals[normalIndex[i] * 3], mesh->normals[normalIndex[i] * 3 + 1], mesh->normals[normalIndex[i] * 3 + 2]);
-			}
-			mesh->curIndex += 3;
-			mesh->numFaces += 1;
+	// Single pass over the chunk, the lines are parsed in place.
+	// The source does not need to be zero terminated, it may be a read-only file mapping.
+	void parseChunk(ObjChunk& chunk) {
+		const char* end = chunk.end;
+		const char* line = chunk.begin;
+		while (line < end) {
+			const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+			if (lineEnd == nullptr) lineEnd = end;
+			parseLine(chunk, line, lineEnd);
+			++chunk.lines;
+			line = lineEnd + 1;
 		}
 	}
 
-	void parseUV(Mesh* mesh, char* line) {
-		char* token;
-		for (int i = 0; i < 2; i++) {
-			token = strtok(nullptr, " ");
-			*mesh->curUV = (float)strtod(token, nullptr);
-			mesh->curUV++;
+	// One chunk per thread of the job system, the calling thread included
+	int chooseChunkCount(int length) {
+		int threads = jobThreadCount() + 1;
+		int chunks = length / minChunkSize;
+		return chunks < 1 ? 1 : (chunks > threads ? threads : chunks);
+	}
+
+	// Splits the source into chunks of roughly equal size which end at a newline
+	void splitChunks(ObjChunk* chunks, int count, const char* source, int length) {
+		const char* end = source + length;
+		const char* begin = source;
+		for (int i = 0; i < count; ++i) {
+			const char* chunkEnd = i == count - 1 ? end : source + (long long)length * (i + 1) / count;
+			if (chunkEnd < begin) chunkEnd = begin;
+			if (chunkEnd < end) {
+				const char* newline = (const char*)memchr(chunkEnd, '\n', end - chunkEnd);
+				chunkEnd = newline == nullptr ? end : newline + 1;
+			}
+			chunks[i].begin = begin;
+			chunks[i].end = chunkEnd;
+			chunks[i].lines = 0;
+			begin = chunkEnd;
 		}
 	}
 
-	void parseNormal(Mesh* mesh, char* line) {
-		char* token;
-		for (int i = 0; i < 3; i++) {
-			token = strtok(nullptr, " ");
-			*mesh->curNormal = (float)strtod(token, nullptr);
-			mesh->curNormal++;
+	template<typename T>
+	void copyInto(T* target, const GrowableArray<T>& source) {
+		if (source.count > 0) memcpy(target, source.data, source.count * sizeof(T));
+	}
+
+	void fixRelative(const ObjChunk& chunk, int* corners) {
+		const int offsets[3] = { chunk.positionOffset, chunk.uvOffset, chunk.normalOffset };
+		for (int i = 0; i < chunk.relativeCorners.count; ++i) {
+			int corner = chunk.relativeCorners.data[i];
+			corners[chunk.cornerOffset + corner] += offsets[corner % 3];
 		}
 	}
 
-	void parseLine(Mesh* mesh, char* line) {
-		char* token = strtok(line, " ");
-		if (strcmp(token, "v") == 0) {
-			// Read some vertex data
-			parseVertex(mesh, line);
+	// Copies a chunk into the merged arrays at the offsets from the prefix sum
+	void mergeChunk(const ObjChunk& chunk, float* positions, float* uvs, float* normals, int* corners) {
+		copyInto(positions + chunk.positionOffset * 3, chunk.positions);
+		copyInto(uvs + chunk.uvOffset * 2, chunk.uvs);
+		copyInto(normals + chunk.normalOffset * 3, chunk.normals);
+		copyInto(corners + chunk.cornerOffset, chunk.corners);
+		fixRelative(chunk, corners);
+	}
+
+	// Builds one vertex per distinct position/uv/normal triple so corners which share a position
+	// but not its uv or normal (seams, hard edges) keep their own attributes.
+	// Triangles referencing missing positions are dropped, missing uvs or normals become 0.
+	// The vertices are written into sink with their positions scaled.
+	void weldVertices(ScratchArena& scratch, const float* positions, int numPositions, const float* uvs, int numUVs,
+		const float* normals, int numNormals, int* corners, int numCorners, float scale, MeshSink& sink) {
+		for (int i = 0; i < numCorners; ++i) {
+			int* corner = &corners[i * 3];
+			if (corner[1] < 0 || corner[1] >= numUVs) corner[1] = -1;
+			if (corner[2] < 0 || corner[2] >= numNormals) corner[2] = -1;
 		}
-		else if (strcmp(token, "f") == 0) {
-			// Read some face data
-			parseFace(mesh, line);
+
+		VertexMap map(scratch, numCorners);
+		int* indices = scratch.allocate<int>(numCorners);
+		int numIndices = 0;
+		for (int triangle = 0; triangle < numCorners / 3; ++triangle) {
+			const int* corner = &corners[triangle * 9];
+			if (corner[0] < 0 || corner[0] >= numPositions || corner[3] < 0 || corner[3] >= numPositions || corner[6] < 0 || corner[6] >= numPositions) continue;
+			for (int i = 0; i < 3; ++i) {
+				indices[numIndices++] = map.insert(&corner[i * 3]);
+			}
 		}
-		else if (strcmp(token, "vt") == 0) {
-			parseUV(mesh, line);
-		} else if (strcmp(token, "vn") == 0) {
-			parseNormal(mesh, line);
+
+		float* vertices;
+		int* targetIndices;
+		sink.begin(map.size(), numIndices, vertices, targetIndices);
+		for (int i = 0; i < map.size(); ++i) {
+			const int* key = map.key(i);
+			float* vertex = &vertices[i * 8];
+			const float* position = &positions[key[0] * 3];
+			vertex[0] = position[0] * scale;
+			vertex[1] = position[1] * scale;
+			vertex[2] = position[2] * scale;
+			if (key[1] >= 0) {
+				vertex[3] = uvs[key[1] * 2];
+				vertex[4] = uvs[key[1] * 2 + 1];
+			}
+			else {
+				vertex[3] = vertex[4] = 0;
+			}
+			if (key[2] >= 0) {
+				vertex[5] = normals[key[2] * 3];
+				vertex[6] = normals[key[2] * 3 + 1];
+				vertex[7] = normals[key[2] * 3 + 2];
+			}
+			else {
+				vertex[5] = vertex[6] = vertex[7] = 0;
+			}
 		}
+		if (numIndices > 0) memcpy(targetIndices, indices, numIndices * sizeof(int));
+		sink.end();
+	}
+
+	// Allocates the mesh once the sizes are known
+	class MeshAllocator : public MeshSink {
+	public:
+		void begin(int numVertices, int numIndices, float*& vertices, int*& indices) override {
+			mesh = Mesh(numVertices, numIndices / 3);
+			vertices = mesh.vertices;
+			indices = mesh.indices;
+		}
+
+		Mesh mesh;
+	};
+}
 
-		// Ignore all other commands (for now)	
+Mesh::Mesh() : numFaces(0), numVertices(0), vertices(nullptr), indices(nullptr), memory(nullptr) {}
+
+Mesh::Mesh(int numVertices, int numFaces) : numFaces(numFaces), numVertices(numVertices) {
+	memory = new char[sizeInBytes()];
+	vertices = reinterpret_cast<float*>(memory);
+	indices = reinterpret_cast<int*>(memory + numVertices * 8 * sizeof(float));
+	addMeshBytes(sizeInBytes());
+}
+
+Mesh::Mesh(Mesh&& other) : numFaces(other.numFaces), numVertices(other.numVertices), vertices(other.vertices), indices(other.indices), memory(other.memory) {
+	other.numFaces = other.numVertices = 0;
+	other.vertices = nullptr;
+	other.indices = nullptr;
+	other.memory = nullptr;
+}
+
+Mesh::~Mesh() {
+	if (memory != nullptr) liveMeshBytes -= sizeInBytes();
+	delete[] memory;
+}
+
+// other frees what this held
+Mesh& Mesh::operator=(Mesh&& other) {
+	std::swap(numFaces, other.numFaces);
+	std::swap(numVertices, other.numVertices);
+	std::swap(vertices, other.vertices);
+	std::swap(indices, other.indices);
+	std::swap(memory, other.memory);
+	return *this;
+}
+
+bool loadObj(const char* filename, MeshSink& sink, float scale, ObjLoadStats* stats) {
+	double startTime = System::time();
+
+	MappedFile file(filename);
+	int length = file.size();
+
+	// Parse newline aligned chunks in parallel
+	int chunkCount = chooseChunkCount(length);
+	ObjChunk* chunks = chunkPool.get(chunkCount);
+	splitChunks(chunks, chunkCount, file.data(), length);
+	parallelFor(chunkCount, 1, [chunks](int begin, int end) {
+		for (int i = begin; i < end; ++i) parseChunk(chunks[i]);
+	}, "Parse OBJ chunk");
+
+	// Prefix sum over the chunk sizes gives every chunk its place in the merged arrays
+	int positions = 0, uvs = 0, normals = 0, corners = 0, lines = 0;
+	for (int i = 0; i < chunkCount; ++i) {
+		ObjChunk& chunk = chunks[i];
+		chunk.positionOffset = positions;
+		chunk.uvOffset = uvs;
+		chunk.normalOffset = normals;
+		chunk.cornerOffset = corners;
+		positions += chunk.positions.count / 3;
+		uvs += chunk.uvs.count / 2;
+		normals += chunk.normals.count / 3;
+		corners += chunk.corners.count;
+		lines += chunk.lines;
+	}
+
+	ScratchArena& scratch = ScratchArena::local();
+	ScratchArena::Scope scope(scratch);
+	float* positionData;
+	float* uvData;
+	float* normalData;
+	int* cornerData;
+	if (chunkCount == 1) {
+		// Nothing to merge, use the chunk's arrays
+		positionData = chunks[0].positions.data;
+		uvData = chunks[0].uvs.data;
+		normalData = chunks[0].normals.data;
+		cornerData = chunks[0].corners.data;
+		fixRelative(chunks[0], cornerData);
+	}
+	else {
+		positionData = scratch.allocate<float>(positions * 3);
+		uvData = scratch.allocate<float>(uvs * 2);
+		normalData = scratch.allocate<float>(normals * 3);
+		cornerData = scratch.allocate<int>(corners);
+		parallelFor(chunkCount, 1, [chunks, positionData, uvData, normalData, cornerData](int begin, int end) {
+			for (int i = begin; i < end; ++i) mergeChunk(chunks[i], positionData, uvData, normalData, cornerData);
+		}, "Merge OBJ chunk");
+	}
+
+	weldVertices(scratch, positionData, positions, uvData, uvs, normalData, normals, cornerData, corners / 3, scale, sink);
+	for (int i = 0; i < chunkCount; ++i) chunks[i].clear();
+
+	if (stats != nullptr) {
+		stats->bytes = length;
+		stats->lines = lines;
+		stats->positions = positions;
+		stats->threads = chunkCount;
+		stats->seconds = System::time() - startTime;
 	}
+
+	return file.data() != nullptr;
+}
+
+Mesh loadObj(const char* filename, float scale, ObjLoadStats* stats) {
+	MeshAllocator allocator;
+	loadObj(filename, allocator, scale, stats);
+	return std::move(allocator.mesh);
+}
+
+int meshBytes() {
+	return liveMeshBytes;
 }
 
-Mesh* loadObj(const char* filename) {
-	FileReader fileReader(filename, FileReader::Asset);
-	void* data = fileReader.readAll();
-	int length = fileReader.size() + 1;
-	char* source = new char[length];
-	for (int i = 0; i < length; ++i) source[i] = reinterpret_cast<char*>(data)[i];
-	source[length] = 0;
-	
-	Mesh* mesh = new Mesh;
-
-	int vertices = countVertices(source);
-	mesh->vertices = new float[vertices * 8];
-	mesh->curVertex = mesh->vertices;
-	int faces = countFaces(source);
-	mesh->indices = new int[faces * 3];
-	mesh->curIndex = mesh->indices;
-	mesh->numUVs = countUVs(source);
-	mesh->uvs = new float[mesh->numUVs * 2];
-	mesh->curUV = mesh->uvs;
-	int normals = countNormals(source);
-	mesh->numNormals = normals;
-	mesh->normals = new float[normals * 3];
-	mesh->curNormal = mesh->normals;
-
-
-
-	
-	mesh->numVertices = 0;
-	mesh->numFaces = 0;
-	
-	
-	
-	int index = 0;
-	char* line = tokenize(source, '\n', index);
-	
-	while (line != nullptr) {
-		parseLine(mesh, line);
-		delete[] line;
-		line = tokenize(source, '\n', index);
-	}
-
-	return mesh;
+int peakMeshBytes() {
+	return peakLiveMeshBytes;
 }
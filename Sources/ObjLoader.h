@@ -1,21 +1,66 @@
 #pragma once
 
+// Indexed triangle mesh. Every distinct position/uv/normal combination of the OBJ
+// becomes one vertex of 8 floats: position, uv, normal. The vertices and indices are one
+// allocation the mesh owns, so a mesh can be moved but not copied.
 struct Mesh {
+	Mesh();
+	// Uninitialized vertices and indices
+	Mesh(int numVertices, int numFaces);
+	Mesh(Mesh&& other);
+	~Mesh();
+
+	Mesh& operator=(Mesh&& other);
+
+	int sizeInBytes() const { return numVertices * 8 * sizeof(float) + numFaces * 3 * sizeof(int); }
+
 	int numFaces;
 	int numVertices;
-	int numUVs;
-	int numNormals;
 
 	float* vertices;
 	int* indices;
-	float* uvs;
-	float * normals;
-
-	// very private
-	float* curVertex;
-	int* curIndex;
-	float* curUV;
-	float* curNormal;
+
+private:
+	Mesh(const Mesh&);
+	Mesh& operator=(const Mesh&);
+
+	char* memory;
+};
+
+// Throughput of the last load, filled in by loadObj when requested
+struct ObjLoadStats {
+	int bytes;
+	int lines;
+	int positions;
+	int threads; // chunks parsed as job tasks, at most the job threads plus the caller
+	double seconds;
+
+	double bytesPerSecond() const { return seconds > 0.0 ? bytes / seconds : 0.0; }
+	double linesPerSecond() const { return seconds > 0.0 ? lines / seconds : 0.0; }
 };
 
-Mesh* loadObj(const char* filename);
+// Destination of a streaming load, such as a Mesh or memory the caller reuses between loads
+class MeshSink {
+public:
+	virtual ~MeshSink() {}
+
+	// Called once the sizes are known, before anything is written. The sink provides room for
+	// numVertices vertices of 8 floats and numIndices indices.
+	virtual void begin(int numVertices, int numIndices, float*& vertices, int*& indices) = 0;
+
+	// Called once everything is written
+	virtual void end() {}
+};
+
+// Parses the OBJ and writes the welded vertices, with their positions multiplied by scale, and
+// the indices straight into sink. The temporaries of the parse come from scratch arenas (see
+// ScratchArena.h) which the calling thread keeps for its next load. Returns false if the file
+// could not be opened, the sink then gets an empty mesh.
+bool loadObj(const char* filename, MeshSink& sink, float scale = 1.0f, ObjLoadStats* stats = nullptr);
+
+// Loads into a mesh of its own
+Mesh loadObj(const char* filename, float scale = 1.0f, ObjLoadStats* stats = nullptr);
+
+// Of all meshes alive right now, and the most there were at once
+int meshBytes();
+int peakMeshBytes();
@@ -0,0 +1,114 @@
+#include "pch.h"
+#include "ParticleRenderer.h"
+#include "ObjLoader.h"
+#include "ParticleSystem.h"
+#include <cstring>
+
+using namespace Kore;
+
+namespace {
+	// position, uv, color
+	const int particleVertexSize = 3 + 2 + 4;
+}
+
+ParticleRenderer::ParticleRenderer(const Mesh& sprite) : indexBuffer(nullptr), capacity(0), nextBuffer(0) {
+	structure.add(Graphics4::VertexCoord, Graphics4::Float3VertexData);
+	structure.add(Graphics4::VertexTexCoord0, Graphics4::Float2VertexData);
+	structure.add(Graphics4::VertexColor0, Graphics4::Float4VertexData);
+	for (int i = 0; i < bufferCount; ++i) vertexBuffers[i] = nullptr;
+
+	spriteVertices = sprite.numVertices;
+	spriteIndices = sprite.numFaces * 3;
+	spritePositions = new float[spriteVertices * 3];
+	spriteUVs = new float[spriteVertices * 2];
+	turnedPositions = new float[spriteVertices * 3];
+	spriteIndexData = new int[spriteIndices];
+	for (int i = 0; i < spriteVertices; ++i) {
+		memcpy(&spritePositions[i * 3], &sprite.vertices[i * 8], 3 * sizeof(float));
+		memcpy(&spriteUVs[i * 2], &sprite.vertices[i * 8 + 3], 2 * sizeof(float));
+	}
+	memcpy(spriteIndexData, sprite.indices, spriteIndices * sizeof(int));
+}
+
+ParticleRenderer::~ParticleRenderer() {
+	for (int i = 0; i < bufferCount; ++i) delete vertexBuffers[i];
+	delete indexBuffer;
+	delete[] spritePositions;
+	delete[] spriteUVs;
+	delete[] turnedPositions;
+	delete[] spriteIndexData;
+}
+
+void ParticleRenderer::reserve(int particles) {
+	if (particles <= capacity) return;
+	capacity = particles;
+
+	for (int i = 0; i < bufferCount; ++i) {
+		delete vertexBuffers[i];
+		vertexBuffers[i] = new Graphics3::VertexBuffer(capacity * spriteVertices, structure, 0);
+	}
+
+	// The indices are the same every frame
+	delete indexBuffer;
+	indexBuffer = new Graphics3::IndexBuffer(capacity * spriteIndices);
+	int* indices = indexBuffer->lock();
+	for (int particle = 0; particle < capacity; ++particle) {
+		for (int i = 0; i < spriteIndices; ++i) {
+			*indices++ = particle * spriteVertices + spriteIndexData[i];
+		}
+	}
+	indexBuffer->unlock();
+}
+
+void ParticleRenderer::draw(const ParticleSystem& particles, const mat4& orientation) {
+	const int count = particles.count();
+	if (count == 0 || spriteIndices == 0) return;
+	reserve(count);
+
+	// The sprite turned towards the camera, the same for every particle
+	for (int i = 0; i < spriteVertices; ++i) {
+		const float* p = &spritePositions[i * 3];
+		for (int row = 0; row < 3; ++row) {
+			turnedPositions[i * 3 + row] = orientation.get(row, 0) * p[0] + orientation.get(row, 1) * p[1] + orientation.get(row, 2) * p[2];
+		}
+	}
+
+	// Depth along the view direction (left handed, the camera looks down +z), only the order matters
+	const float* x = particles.positionsX();
+	const float* y = particles.positionsY();
+	const float* z = particles.positionsZ();
+	const float forwardX = orientation.get(0, 2);
+	const float forwardY = orientation.get(1, 2);
+	const float forwardZ = orientation.get(2, 2);
+	if ((int)depths.size() < count) depths.resize(count);
+	float* depth = depths.data();
+	for (int particle = 0; particle < count; ++particle) {
+		depth[particle] = -(x[particle] * forwardX + y[particle] * forwardY + z[particle] * forwardZ);
+	}
+	const int* order = sorter.sort(depth, count);
+
+	Graphics3::VertexBuffer* vertexBuffer = vertexBuffers[nextBuffer];
+	nextBuffer = (nextBuffer + 1) % bufferCount;
+
+	float* vertex = vertexBuffer->lock();
+	for (int sorted = 0; sorted < count; ++sorted) {
+		const int particle = order[sorted];
+		const float alpha = particles.alpha(particle);
+		for (int i = 0; i < spriteVertices; ++i) {
+			const float* corner = &turnedPositions[i * 3];
+			vertex[0] = x[particle] + corner[0];
+			vertex[1] = y[particle] + corner[1];
+			vertex[2] = z[particle] + corner[2];
+			vertex[3] = spriteUVs[i * 2];
+			vertex[4] = spriteUVs[i * 2 + 1];
+			vertex[5] = vertex[6] = vertex[7] = 1.0f;
+			vertex[8] = alpha;
+			vertex += particleVertexSize;
+		}
+	}
+	vertexBuffer->unlock();
+
+	Graphics3::setVertexBuffer(*vertexBuffer);
+	Graphics3::setIndexBuffer(*indexBuffer);
+	Graphics3::drawIndexedVertices(0, count * spriteIndices);
+}
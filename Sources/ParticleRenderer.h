@@ -0,0 +1,47 @@
+#pragma once
+
+#include "RadixSort.h"
+#include <Kore/Graphics3/Graphics.h>
+#include <vector>
+
+struct Mesh;
+class ParticleSystem;
+
+// Draws all particles in one call. Every frame a copy of the sprite mesh is written into a
+// dynamic vertex buffer for each particle, turned like the camera and carrying the particle's
+// alpha in its vertex color. The particles are written back to front by their view depth for
+// alpha blending without depth test. The vertex buffers are used in turns so the one the GPU may
+// still be reading is not locked again in the next frame.
+class ParticleRenderer {
+public:
+	// sprite is copied, it needs positions and uvs only
+	ParticleRenderer(const Mesh& sprite);
+	~ParticleRenderer();
+
+	// orientation is the camera's world matrix
+	void draw(const ParticleSystem& particles, const Kore::mat4& orientation);
+
+private:
+	ParticleRenderer(const ParticleRenderer&);
+	ParticleRenderer& operator=(const ParticleRenderer&);
+
+	void reserve(int particles);
+
+	static const int bufferCount = 3;
+
+	Kore::Graphics4::VertexStructure structure;
+	Kore::Graphics3::VertexBuffer* vertexBuffers[bufferCount];
+	Kore::Graphics3::IndexBuffer* indexBuffer;
+	int capacity; // particles
+	int nextBuffer;
+
+	int spriteVertices;
+	int spriteIndices;
+	float* spritePositions;
+	float* spriteUVs;
+	float* turnedPositions; // spritePositions rotated like the camera
+	int* spriteIndexData;
+
+	std::vector<float> depths; // negated view depths, so ascending keys are back to front
+	RadixSorter sorter;
+};
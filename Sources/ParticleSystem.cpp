@@ -0,0 +1,266 @@
+#include "pch.h"
+#include "ParticleSystem.h"
+#include "JobSystem.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define PARTICLES_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PARTICLES_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace Kore;
+
+namespace {
+	const float gravity = -9.81f * 0.1f;
+	const float floorHeight = -2.0f;
+	const float launchSpeed = 1.3f;
+	const float spread = 0.3f;
+
+	// A new particle starts up to this many steps into its flight
+	const int maxWarmupSteps = 300;
+
+	// More steps due in one update are skipped analytically
+	const int maxStepsPerUpdate = 4;
+
+	const int maxLanes = 8;
+
+	// Particles simulated by one task, each block has its own random number state
+	const int blockSize = 16 * 1024;
+	const int alignment = 32;
+
+	u32 xorshift(u32 x) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		return x;
+	}
+
+	// The upper 23 bits as the mantissa of a float in [1, 2), moved to [-spread, spread)
+	float sidewaysSpeed(u32 bits) {
+		u32 one = (bits >> 9) | 0x3f800000u;
+		float value;
+		memcpy(&value, &one, sizeof(value));
+		return (value - 1.5f) * 2.0f * spread;
+	}
+
+#if defined(PARTICLES_AVX2)
+	const int lanes = 8;
+	typedef __m256 Floats;
+	typedef __m256i Ints;
+	Floats load(const float* p) { return _mm256_load_ps(p); }
+	void store(float* p, Floats v) { _mm256_store_ps(p, v); }
+	Floats broadcast(float f) { return _mm256_set1_ps(f); }
+	Floats add(Floats a, Floats b) { return _mm256_add_ps(a, b); }
+	Floats sub(Floats a, Floats b) { return _mm256_sub_ps(a, b); }
+	Floats mul(Floats a, Floats b) { return _mm256_mul_ps(a, b); }
+	Floats less(Floats a, Floats b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	bool any(Floats mask) { return _mm256_movemask_ps(mask) != 0; }
+	Floats select(Floats mask, Floats a, Floats b) { return _mm256_blendv_ps(b, a, mask); }
+	Ints loadInts(const u32* p) { return _mm256_loadu_si256(reinterpret_cast<const Ints*>(p)); }
+	void storeInts(u32* p, Ints v) { _mm256_storeu_si256(reinterpret_cast<Ints*>(p), v); }
+	Ints xorInts(Ints a, Ints b) { return _mm256_xor_si256(a, b); }
+	Ints orInts(Ints a, Ints b) { return _mm256_or_si256(a, b); }
+	Ints broadcastInt(u32 i) { return _mm256_set1_epi32((int)i); }
+	template<int bits> Ints shiftLeft(Ints v) { return _mm256_slli_epi32(v, bits); }
+	template<int bits> Ints shiftRight(Ints v) { return _mm256_srli_epi32(v, bits); }
+	Floats asFloats(Ints v) { return _mm256_castsi256_ps(v); }
+#elif defined(PARTICLES_SSE2)
+	const int lanes = 4;
+	typedef __m128 Floats;
+	typedef __m128i Ints;
+	Floats load(const float* p) { return _mm_load_ps(p); }
+	void store(float* p, Floats v) { _mm_store_ps(p, v); }
+	Floats broadcast(float f) { return _mm_set1_ps(f); }
+	Floats add(Floats a, Floats b) { return _mm_add_ps(a, b); }
+	Floats sub(Floats a, Floats b) { return _mm_sub_ps(a, b); }
+	Floats mul(Floats a, Floats b) { return _mm_mul_ps(a, b); }
+	Floats less(Floats a, Floats b) { return _mm_cmplt_ps(a, b); }
+	bool any(Floats mask) { return _mm_movemask_ps(mask) != 0; }
+	Floats select(Floats mask, Floats a, Floats b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	Ints loadInts(const u32* p) { return _mm_loadu_si128(reinterpret_cast<const Ints*>(p)); }
+	void storeInts(u32* p, Ints v) { _mm_storeu_si128(reinterpret_cast<Ints*>(p), v); }
+	Ints xorInts(Ints a, Ints b) { return _mm_xor_si128(a, b); }
+	Ints orInts(Ints a, Ints b) { return _mm_or_si128(a, b); }
+	Ints broadcastInt(u32 i) { return _mm_set1_epi32((int)i); }
+	template<int bits> Ints shiftLeft(Ints v) { return _mm_slli_epi32(v, bits); }
+	template<int bits> Ints shiftRight(Ints v) { return _mm_srli_epi32(v, bits); }
+	Floats asFloats(Ints v) { return _mm_castsi128_ps(v); }
+#endif
+
+#if defined(PARTICLES_AVX2) || defined(PARTICLES_SSE2)
+	Ints xorshift(Ints x) {
+		x = xorInts(x, shiftLeft<13>(x));
+		x = xorInts(x, shiftRight<17>(x));
+		return xorInts(x, shiftLeft<5>(x));
+	}
+
+	Floats sidewaysSpeed(Ints bits) {
+		Floats value = asFloats(orInts(shiftRight<9>(bits), broadcastInt(0x3f800000u)));
+		return mul(sub(value, broadcast(1.5f)), broadcast(2.0f * spread));
+	}
+#endif
+}
+
+ParticleSystem::ParticleSystem(int count, u32 seed) : numParticles(count), pendingTime(0) {
+	capacity = (count + maxLanes - 1) / maxLanes * maxLanes;
+
+	// Seven arrays, each starting on an alignment boundary
+	memory = new float[capacity * 7 + alignment / sizeof(float)];
+	float* aligned = reinterpret_cast<float*>((reinterpret_cast<uintptr_t>(memory) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	positionX = aligned;
+	positionY = positionX + capacity;
+	positionZ = positionY + capacity;
+	velocityX = positionZ + capacity;
+	velocityY = velocityX + capacity;
+	velocityZ = velocityY + capacity;
+	age = velocityZ + capacity;
+
+	const int blocks = (capacity + blockSize - 1) / blockSize;
+	random = new u32[(blocks > 0 ? blocks : 1) * maxLanes];
+	u32 state = seed == 0 ? 1 : seed;
+	for (int i = 0; i < blocks * maxLanes; ++i) {
+		state = xorshift(state + 0x9e3779b9u);
+		random[i] = state == 0 ? 1 : state;
+	}
+
+	// Step a flight the way simulate does to count its steps
+	float height = 0, upwardSpeed = launchSpeed;
+	flightSteps = 0;
+	do {
+		upwardSpeed += gravity * particleTimeStep;
+		height += upwardSpeed * particleTimeStep;
+		++flightSteps;
+	} while (height >= floorHeight);
+
+	for (int i = 0; i < capacity; ++i) {
+		launch(i);
+		advance(i, i + 1, (int)(nextRandom(i) % maxWarmupSteps));
+	}
+}
+
+ParticleSystem::~ParticleSystem() {
+	delete[] memory;
+	delete[] random;
+}
+
+u32 ParticleSystem::nextRandom(int particle) {
+	u32& state = random[particle / blockSize * maxLanes + particle % maxLanes];
+	state = xorshift(state);
+	return state;
+}
+
+void ParticleSystem::launch(int particle) {
+	positionX[particle] = positionY[particle] = positionZ[particle] = 0;
+	velocityX[particle] = sidewaysSpeed(nextRandom(particle));
+	velocityY[particle] = launchSpeed;
+	velocityZ[particle] = sidewaysSpeed(nextRandom(particle));
+	age[particle] = 0;
+}
+
+void ParticleSystem::simulateScalar(int begin, int end, float deltaTime) {
+	const float fall = gravity * deltaTime;
+	for (int i = begin; i < end; ++i) {
+		age[i] += deltaTime;
+		velocityY[i] += fall;
+		positionX[i] += velocityX[i] * deltaTime;
+		positionY[i] += velocityY[i] * deltaTime;
+		positionZ[i] += velocityZ[i] * deltaTime;
+		if (positionY[i] < floorHeight) launch(i);
+	}
+}
+
+// Closed form of steps of particleTimeStep: after n steps of a flight the upward speed is
+// launchSpeed + n g dt, the position the sum of the speeds after every step times dt.
+// A particle whose flight ends on the way is launched again and continues from there.
+void ParticleSystem::advance(int begin, int end, int steps) {
+	const float dt = particleTimeStep;
+	for (int i = begin; i < end; ++i) {
+		int step = (int)(age[i] / dt + 0.5f) + steps;
+		if (step >= flightSteps) {
+			launch(i);
+			step %= flightSteps;
+		}
+		const float n = (float)step;
+		velocityY[i] = launchSpeed + n * gravity * dt;
+		positionX[i] = n * dt * velocityX[i];
+		positionY[i] = n * dt * launchSpeed + gravity * dt * dt * n * (n + 1.0f) * 0.5f;
+		positionZ[i] = n * dt * velocityZ[i];
+		age[i] = n * dt;
+	}
+}
+
+void ParticleSystem::update(float frameTime) {
+	pendingTime += frameTime;
+	int steps = (int)(pendingTime / particleTimeStep);
+	pendingTime -= steps * particleTimeStep;
+	if (steps > maxStepsPerUpdate) {
+		skip(steps);
+	}
+	else {
+		for (int step = 0; step < steps; ++step) simulate(particleTimeStep);
+	}
+}
+
+void ParticleSystem::fastForward(float seconds) {
+	skip((int)(seconds / particleTimeStep + 0.5f));
+}
+
+void ParticleSystem::skip(int steps) {
+	if (steps > 0) parallelFor(capacity, blockSize, [this, steps](int begin, int end) { advance(begin, end, steps); }, "Fast forward particles");
+}
+
+void ParticleSystem::simulate(float deltaTime) {
+	parallelFor(capacity, blockSize, [this, deltaTime](int begin, int end) { simulateBlock(begin, end, deltaTime); }, "Simulate particles");
+}
+
+void ParticleSystem::simulateBlock(int begin, int end, float deltaTime) {
+#if defined(PARTICLES_AVX2) || defined(PARTICLES_SSE2)
+	const Floats dt = broadcast(deltaTime);
+	const Floats fall = broadcast(gravity * deltaTime);
+	const Floats floor = broadcast(floorHeight);
+	const Floats zero = broadcast(0.0f);
+	const Floats launchVelocity = broadcast(launchSpeed);
+	u32* blockRandom = &random[begin / blockSize * maxLanes];
+	Ints state = loadInts(blockRandom);
+
+	for (int i = begin; i < end; i += lanes) {
+		Floats vy = add(load(velocityY + i), fall);
+		Floats vx = load(velocityX + i);
+		Floats vz = load(velocityZ + i);
+		Floats x = add(load(positionX + i), mul(vx, dt));
+		Floats y = add(load(positionY + i), mul(vy, dt));
+		Floats z = add(load(positionZ + i), mul(vz, dt));
+		Floats t = add(load(age + i), dt);
+
+		// Launch the ones which fell through the floor again
+		Floats fallen = less(y, floor);
+		if (any(fallen)) {
+			state = xorshift(state);
+			vx = select(fallen, sidewaysSpeed(state), vx);
+			state = xorshift(state);
+			vz = select(fallen, sidewaysSpeed(state), vz);
+			vy = select(fallen, launchVelocity, vy);
+			x = select(fallen, zero, x);
+			y = select(fallen, zero, y);
+			z = select(fallen, zero, z);
+			t = select(fallen, zero, t);
+			store(velocityX + i, vx);
+			store(velocityZ + i, vz);
+		}
+
+		store(velocityY + i, vy);
+		store(positionX + i, x);
+		store(positionY + i, y);
+		store(positionZ + i, z);
+		store(age + i, t);
+	}
+
+	storeInts(blockRandom, state);
+#else
+	simulateScalar(begin, end, deltaTime);
+#endif
+}
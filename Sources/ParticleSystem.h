@@ -0,0 +1,67 @@
+#pragma once
+
+// Particles of the particle scene, stored as one array per component so they are simulated
+// several at a time with SSE2/AVX2 where available. They are launched upwards from the origin
+// with a random sideways velocity, fall under gravity and are launched again once they drop
+// below the floor.
+//
+// update() advances in fixed steps of particleTimeStep. Since every flight starts with the same
+// upward speed, every flight takes the same number of steps, so a particle's state after any
+// number of steps has a closed form. fastForward() uses it to jump ahead without simulating.
+
+const float particleTimeStep = 1.0f / 60.0f;
+
+class ParticleSystem {
+public:
+	// Every particle starts at a random point of its first flight
+	ParticleSystem(int count, Kore::u32 seed = 1);
+	~ParticleSystem();
+
+	// Adds frameTime to the time still to be simulated and simulates as many whole steps as are due.
+	// When more than a few steps are due at once (after a hitch) they are skipped with fastForward.
+	void update(float frameTime);
+
+	// One step of deltaTime. Blocks of particles are simulated in parallel when job threads
+	// are running, see JobSystem.h
+	void simulate(float deltaTime);
+
+	// Moves every particle to its state seconds later, rounded to whole steps
+	void fastForward(float seconds);
+
+	int count() const { return numParticles; }
+
+	const float* positionsX() const { return positionX; }
+	const float* positionsY() const { return positionY; }
+	const float* positionsZ() const { return positionZ; }
+
+	// Particles fade in during the first half second of their flight
+	float alpha(int particle) const { return age[particle] < 0.5f ? age[particle] * 2.0f : 1.0f; }
+
+private:
+	ParticleSystem(const ParticleSystem&);
+	ParticleSystem& operator=(const ParticleSystem&);
+
+	void launch(int particle);
+	void advance(int begin, int end, int steps);
+	void skip(int steps);
+	void simulateBlock(int begin, int end, float deltaTime);
+	void simulateScalar(int begin, int end, float deltaTime);
+	Kore::u32 nextRandom(int particle);
+
+	int numParticles;
+	int capacity; // numParticles rounded up to whole SIMD vectors
+	int flightSteps; // from a launch until the particle falls below the floor
+	float pendingTime; // not simulated yet, less than a step after update
+
+	float* memory;
+	float* positionX;
+	float* positionY;
+	float* positionZ;
+	float* velocityX;
+	float* velocityY;
+	float* velocityZ;
+	float* age;
+
+	// xorshift32 state of every SIMD lane, per block of particles
+	Kore::u32* random;
+};
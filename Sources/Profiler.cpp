@@ -0,0 +1,210 @@
+#include "pch.h"
+#include "Profiler.h"
+
+#ifdef ENABLE_PROFILER
+
+#include <Kore/Log.h>
+#include <Kore/System.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace Kore;
+
+namespace {
+	// Zones a thread can record between two endProfilerFrame calls, further ones are dropped
+	const u32 ringSize = 4096;
+
+	// Limits of what is kept between two reports
+	const int maxReportFrames = 3600;
+	const size_t maxTraceZones = 256 * 1024;
+
+	struct ZoneRecord {
+		const char* name;
+		double start;
+		double end;
+	};
+
+	// Written by its thread only and read by endProfilerFrame, the counters only grow
+	struct ThreadZones {
+		ZoneRecord zones[ringSize];
+		std::atomic<u32> written;
+		std::atomic<u32> read;
+		int thread;
+	};
+
+	// Guards the list, not the buffers. Buffers of finished threads are kept, there are few threads.
+	std::mutex threadsMutex;
+	std::vector<ThreadZones*> threads;
+	thread_local ThreadZones* ownZones = nullptr;
+	std::atomic<int> droppedZones(0);
+
+	// Time per frame of a zone, for the frames it ran in
+	struct ZoneStats {
+		const char* name;
+		std::vector<double> frameTimes;
+		double frameTime;
+		bool ran;
+	};
+	std::vector<ZoneStats> zoneStats;
+
+	struct TraceZone {
+		const char* name;
+		int thread;
+		double start;
+		double end;
+	};
+	std::vector<TraceZone> trace;
+
+	double frameStart = -1.0;
+	int frames = 0;
+
+	ThreadZones* registerThread() {
+		ThreadZones* zones = new ThreadZones;
+		zones->written = 0;
+		zones->read = 0;
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		zones->thread = (int)threads.size();
+		threads.push_back(zones);
+		return zones;
+	}
+
+	// Names are compared by content, the same literal can have different addresses in different files
+	ZoneStats& stats(const char* name) {
+		for (size_t i = 0; i < zoneStats.size(); ++i) {
+			if (strcmp(zoneStats[i].name, name) == 0) return zoneStats[i];
+		}
+		ZoneStats newStats;
+		newStats.name = name;
+		newStats.frameTime = 0.0;
+		newStats.ran = false;
+		zoneStats.push_back(newStats);
+		return zoneStats.back();
+	}
+
+	// Nearest rank
+	double percentile(const std::vector<double>& sorted, double p) {
+		int rank = (int)std::ceil(p * sorted.size()) - 1;
+		return sorted[std::max(0, std::min((int)sorted.size() - 1, rank))];
+	}
+
+	struct ZoneReport {
+		const char* name;
+		int frames;
+		double p50;
+		double p95;
+		double p99;
+	};
+
+	std::vector<ZoneReport> report() {
+		std::vector<ZoneReport> reports;
+		for (size_t i = 0; i < zoneStats.size(); ++i) {
+			if (zoneStats[i].frameTimes.empty()) continue;
+			std::vector<double> sorted(zoneStats[i].frameTimes);
+			std::sort(sorted.begin(), sorted.end());
+			ZoneReport zone = { zoneStats[i].name, (int)sorted.size(), percentile(sorted, 0.5), percentile(sorted, 0.95), percentile(sorted, 0.99) };
+			reports.push_back(zone);
+		}
+		return reports;
+	}
+}
+
+double profilerTime() {
+	return System::time();
+}
+
+void recordProfileZone(const char* name, double start, double end) {
+	ThreadZones* zones = ownZones;
+	if (zones == nullptr) ownZones = zones = registerThread();
+
+	u32 written = zones->written.load(std::memory_order_relaxed);
+	if (written - zones->read.load(std::memory_order_acquire) >= ringSize) {
+		++droppedZones;
+		return;
+	}
+	ZoneRecord& record = zones->zones[written % ringSize];
+	record.name = name;
+	record.start = start;
+	record.end = end;
+	zones->written.store(written + 1, std::memory_order_release);
+}
+
+void endProfilerFrame() {
+	const double now = profilerTime();
+	if (frameStart >= 0.0) recordProfileZone("Frame", frameStart, now);
+	frameStart = now;
+
+	{
+		std::lock_guard<std::mutex> lock(threadsMutex);
+		for (size_t i = 0; i < threads.size(); ++i) {
+			ThreadZones* zones = threads[i];
+			u32 written = zones->written.load(std::memory_order_acquire);
+			for (u32 read = zones->read.load(std::memory_order_relaxed); read != written; ++read) {
+				const ZoneRecord& record = zones->zones[read % ringSize];
+				ZoneStats& zone = stats(record.name);
+				zone.frameTime += record.end - record.start;
+				zone.ran = true;
+				if (trace.size() < maxTraceZones) {
+					TraceZone traceZone = { record.name, zones->thread, record.start, record.end };
+					trace.push_back(traceZone);
+				}
+			}
+			zones->read.store(written, std::memory_order_release);
+		}
+	}
+
+	for (size_t i = 0; i < zoneStats.size(); ++i) {
+		ZoneStats& zone = zoneStats[i];
+		if (zone.ran && (int)zone.frameTimes.size() < maxReportFrames) zone.frameTimes.push_back(zone.frameTime);
+		zone.frameTime = 0.0;
+		zone.ran = false;
+	}
+	++frames;
+}
+
+void logProfilerReport() {
+	std::vector<ZoneReport> zones = report();
+	log(Info, "Profile of %d frames, ms per frame (p50 / p95 / p99):", frames);
+	for (size_t i = 0; i < zones.size(); ++i) {
+		log(Info, "  %-22s %7.3f %7.3f %7.3f in %d frames", zones[i].name, zones[i].p50 * 1000.0, zones[i].p95 * 1000.0, zones[i].p99 * 1000.0, zones[i].frames);
+	}
+	int dropped = droppedZones.exchange(0);
+	if (dropped > 0) log(Warning, "  %d zones dropped, a thread recorded more than %d between two frames", dropped, (int)ringSize);
+
+	for (size_t i = 0; i < zoneStats.size(); ++i) zoneStats[i].frameTimes.clear();
+	trace.clear();
+	frames = 0;
+}
+
+// Written with stdio like the baked meshes, next to the assets
+bool writeProfilerCsv(const char* filename) {
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr) return false;
+	std::vector<ZoneReport> zones = report();
+	fprintf(file, "zone,frames,p50_ms,p95_ms,p99_ms\n");
+	for (size_t i = 0; i < zones.size(); ++i) {
+		fprintf(file, "%s,%d,%.4f,%.4f,%.4f\n", zones[i].name, zones[i].frames, zones[i].p50 * 1000.0, zones[i].p95 * 1000.0, zones[i].p99 * 1000.0);
+	}
+	return fclose(file) == 0;
+}
+
+bool writeProfilerTrace(const char* filename) {
+	FILE* file = fopen(filename, "w");
+	if (file == nullptr) return false;
+	double origin = trace.empty() ? 0.0 : trace[0].start;
+	for (size_t i = 0; i < trace.size(); ++i) origin = std::min(origin, trace[i].start);
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < trace.size(); ++i) {
+		// Complete events, times in microseconds
+		fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n", trace[i].name, trace[i].thread,
+			(trace[i].start - origin) * 1000000.0, (trace[i].end - trace[i].start) * 1000000.0, i + 1 < trace.size() ? "," : "");
+	}
+	fprintf(file, "]}\n");
+	return fclose(file) == 0;
+}
+
+#endif
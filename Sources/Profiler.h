@@ -0,0 +1,55 @@
+#pragma once
+
+// Frame profiler. PROFILE_ZONE("Name") times the rest of the enclosing scope as a named zone,
+// the name has to be a string literal. Every thread writes its zones into a ring buffer of its
+// own without locking, endProfilerFrame collects them on the render thread once per frame.
+//
+// Zones are only compiled in with ENABLE_PROFILER defined, which korefile.js does for development
+// builds only. Without it PROFILE_ZONE expands to nothing and the functions below do nothing.
+
+#ifdef ENABLE_PROFILER
+
+double profilerTime();
+void recordProfileZone(const char* name, double start, double end);
+
+class ProfileZone {
+public:
+	ProfileZone(const char* name) : name(name), start(profilerTime()) {}
+	~ProfileZone() { recordProfileZone(name, start, profilerTime()); }
+
+private:
+	ProfileZone(const ProfileZone&);
+	ProfileZone& operator=(const ProfileZone&);
+
+	const char* name;
+	double start;
+};
+
+#define PROFILE_ZONE_NAME(line) profileZone##line
+#define PROFILE_ZONE_LINE(name, line) ProfileZone PROFILE_ZONE_NAME(line)(name)
+#define PROFILE_ZONE(name) PROFILE_ZONE_LINE(name, __LINE__)
+
+// Collects the zones of all threads which ended since the last call and times the frame itself
+void endProfilerFrame();
+
+// Logs the 50th, 95th and 99th percentile of the time per frame of every zone over the frames
+// collected since the last report, then starts over
+void logProfilerReport();
+
+// The same numbers as logProfilerReport as CSV, one zone per row
+bool writeProfilerCsv(const char* filename);
+
+// The zones of the frames since the last report in Chrome's trace event format
+// (chrome://tracing or ui.perfetto.dev)
+bool writeProfilerTrace(const char* filename);
+
+#else
+
+#define PROFILE_ZONE(name)
+
+inline void endProfilerFrame() {}
+inline void logProfilerReport() {}
+inline bool writeProfilerCsv(const char*) { return false; }
+inline bool writeProfilerTrace(const char*) { return false; }
+
+#endif
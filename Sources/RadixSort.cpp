@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "RadixSort.h"
+#include "JobSystem.h"
+#include <cstring>
+
+using namespace Kore;
+
+namespace {
+	// Three passes over 11 bit digits
+	const int digitBits = 11;
+	const int digits = 1 << digitBits;
+	const int passes = (32 + digitBits - 1) / digitBits;
+
+	// Fewer keys are not worth a task
+	const int minChunkSize = 16 * 1024;
+
+	// Float bits which sort like the floats as unsigned integers: negative floats are
+	// inverted completely, positive ones get the sign bit set
+	u32 sortableBits(float key) {
+		u32 bits;
+		memcpy(&bits, &key, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+	}
+
+	// Key in the upper, index in the lower half so both move with one store
+	int digit(u64 item, int pass) {
+		return (int)(item >> (32 + pass * digitBits)) & (digits - 1);
+	}
+}
+
+const int* RadixSorter::sort(const float* keys, int count) {
+	const int threads = jobThreadCount() + 1;
+	int chunks = count / minChunkSize;
+	if (chunks > threads) chunks = threads;
+	if (chunks < 1) chunks = 1;
+	const int chunkSize = count > 0 ? (count + chunks - 1) / chunks : 1;
+
+	if ((int)items[0].size() < count) items[0].resize(count);
+	if ((int)items[1].size() < count) items[1].resize(count);
+	if ((int)order.size() < count) order.resize(count);
+	if ((int)histograms.size() < chunks * digits) histograms.resize(chunks * digits);
+
+	u64* source = items[0].data();
+	parallelFor(count, chunkSize, [source, keys](int begin, int end) {
+		for (int i = begin; i < end; ++i) source[i] = (u64)sortableBits(keys[i]) << 32 | (u32)i;
+	}, "Radix sort keys");
+
+	current = 0;
+	for (int pass = 0; pass < passes; ++pass) sortPass(pass, count, chunkSize, chunks);
+
+	const u64* sorted = items[current].data();
+	int* target = order.data();
+	parallelFor(count, chunkSize, [sorted, target](int begin, int end) {
+		for (int i = begin; i < end; ++i) target[i] = (int)(u32)sorted[i];
+	}, "Radix sort indices");
+	return target;
+}
+
+void RadixSorter::sortPass(int pass, int count, int chunkSize, int chunks) {
+	const u64* source = items[current].data();
+	u64* target = items[1 - current].data();
+
+	parallelFor(count, chunkSize, [this, source, pass, chunkSize](int begin, int end) {
+		int* histogram = &histograms[begin / chunkSize * digits];
+		memset(histogram, 0, digits * sizeof(int));
+		for (int i = begin; i < end; ++i) ++histogram[digit(source[i], pass)];
+	}, "Radix sort count");
+
+	// All keys share this digit, the pass would not change the order
+	for (int d = 0; d < digits; ++d) {
+		int total = 0;
+		for (int chunk = 0; chunk < chunks; ++chunk) total += histograms[chunk * digits + d];
+		if (total == count) return;
+		if (total > 0) break;
+	}
+
+	// Every chunk writes its keys of a digit after those of the chunks before it, which keeps the sort stable
+	int offset = 0;
+	for (int d = 0; d < digits; ++d) {
+		for (int chunk = 0; chunk < chunks; ++chunk) {
+			int& counter = histograms[chunk * digits + d];
+			int size = counter;
+			counter = offset;
+			offset += size;
+		}
+	}
+
+	parallelFor(count, chunkSize, [this, source, target, pass, chunkSize](int begin, int end) {
+		int* offsets = &histograms[begin / chunkSize * digits];
+		for (int i = begin; i < end; ++i) target[offsets[digit(source[i], pass)]++] = source[i];
+	}, "Radix sort scatter");
+	current = 1 - current;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+// Sorts indices by float keys with an LSD radix sort over 11 bit digits of the keys.
+// The keys are split into chunks which are counted and scattered in parallel as job tasks
+// (see JobSystem.h), the buffers are kept for the next sort so sorting every frame does
+// not allocate once they are large enough.
+class RadixSorter {
+public:
+	RadixSorter() : current(0) {}
+
+	// Returns the indices 0 ... count - 1 ordered by ascending key, the order of equal keys is kept.
+	// The result stays valid until the next call.
+	const int* sort(const float* keys, int count);
+
+private:
+	void sortPass(int pass, int count, int chunkSize, int chunks);
+
+	std::vector<Kore::u64> items[2]; // sortable key bits and index
+	std::vector<int> order;
+	std::vector<int> histograms; // one counter per digit value and chunk
+	int current; // items buffer holding the latest order
+};
@@ -0,0 +1,142 @@
+#include "pch.h"
+#include "RenderStateCache.h"
+
+using namespace Kore;
+
+namespace {
+	// RenderStateCache::StateValue::type, the setRenderState overload used
+	enum StateType { BoolState, IntState, FloatState };
+}
+
+RenderStateCache::RenderStateCache() : issued(0), elided(0) {}
+
+bool RenderStateCache::same(const mat4& a, const mat4& b) {
+	for (int column = 0; column < 4; ++column) {
+		for (int row = 0; row < 4; ++row) {
+			if (a.get(row, column) != b.get(row, column)) return false;
+		}
+	}
+	return true;
+}
+
+bool RenderStateCache::same(const vec4& a, const vec4& b) {
+	return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+}
+
+RenderStateCache::Cached<RenderStateCache::StateValue>& RenderStateCache::renderState(Graphics3::RenderState state) {
+	for (size_t i = 0; i < renderStates.size(); ++i) {
+		if (renderStates[i].first == state) return renderStates[i].second;
+	}
+	renderStates.push_back(std::make_pair(state, Cached<StateValue>()));
+	return renderStates.back().second;
+}
+
+RenderStateCache::Cached<vec4>& RenderStateCache::materialState(Graphics3::MaterialState state) {
+	for (size_t i = 0; i < materialStates.size(); ++i) {
+		if (materialStates[i].first == state) return materialStates[i].second;
+	}
+	materialStates.push_back(std::make_pair(state, Cached<vec4>()));
+	return materialStates.back().second;
+}
+
+bool RenderStateCache::count(bool changed) {
+	if (changed) ++issued;
+	else ++elided;
+	return changed;
+}
+
+void RenderStateCache::setRenderState(Graphics3::RenderState state, bool value) {
+	StateValue cached = { BoolState, value ? 1 : 0, 0.0f };
+	if (count(renderState(state).change(cached))) Graphics3::setRenderState(state, value);
+}
+
+void RenderStateCache::setRenderState(Graphics3::RenderState state, int value) {
+	StateValue cached = { IntState, value, 0.0f };
+	if (count(renderState(state).change(cached))) Graphics3::setRenderState(state, value);
+}
+
+void RenderStateCache::setRenderState(Graphics3::RenderState state, float value) {
+	StateValue cached = { FloatState, 0, value };
+	if (count(renderState(state).change(cached))) Graphics3::setRenderState(state, value);
+}
+
+void RenderStateCache::setBlendingMode(Graphics3::BlendingOperation source, Graphics3::BlendingOperation destination) {
+	if (count(blendingMode.change(std::make_pair((int)source, (int)destination)))) Graphics3::setBlendingMode(source, destination);
+}
+
+void RenderStateCache::setFogColor(u32 color) {
+	if (count(fogColor.change(color))) Graphics3::setFogColor(Graphics1::Color(color));
+}
+
+void RenderStateCache::setMaterialState(Graphics3::MaterialState state, const vec4& value) {
+	if (count(materialState(state).change(value))) Graphics3::setMaterialState(state, value);
+}
+
+void RenderStateCache::setMaterialState(Graphics3::MaterialState state, float value) {
+	if (count(materialState(state).change(vec4(value, 0.0f, 0.0f, 0.0f)))) Graphics3::setMaterialState(state, value);
+}
+
+void RenderStateCache::setProjectionMatrix(const mat4& value) {
+	if (count(projection.change(value))) Graphics3::setProjectionMatrix(value);
+}
+
+void RenderStateCache::setViewMatrix(const mat4& value) {
+	if (count(view.change(value))) Graphics3::setViewMatrix(value);
+}
+
+void RenderStateCache::setWorldMatrix(const mat4& value) {
+	if (count(world.change(value))) Graphics3::setWorldMatrix(value);
+}
+
+void RenderStateCache::setLight(Light* light, int num) {
+	bool changed = num < 0 || num >= maxLights || lights[num].change(light);
+	if (count(changed)) Graphics3::setLight(light, num);
+}
+
+void RenderStateCache::setTexture(Graphics3::TextureUnit unit, Graphics3::Texture* texture) {
+	bool changed = unit.unit < 0 || unit.unit >= maxTextureUnits || textureUnits[unit.unit].texture.change(texture);
+	if (count(changed)) {
+		Graphics3::setTexture(unit, texture);
+		if (unit.unit >= 0 && unit.unit < maxTextureUnits) textureUnits[unit.unit].mipmapFilter.known = false;
+	}
+}
+
+void RenderStateCache::setTextureMipmapFilter(Graphics3::TextureUnit unit, Graphics3::MipmapFilter filter) {
+	bool changed = unit.unit < 0 || unit.unit >= maxTextureUnits || textureUnits[unit.unit].mipmapFilter.change(filter);
+	if (count(changed)) Graphics3::setTextureMipmapFilter(unit, filter);
+}
+
+void RenderStateCache::setTexCoordGeneration(Graphics3::TextureUnit unit, Graphics3::TexCoord coord, Graphics3::TexGen generation) {
+	bool changed = unit.unit < 0 || unit.unit >= maxTextureUnits || coord < 0 || coord > 1 || textureUnits[unit.unit].coordGeneration[coord].change(generation);
+	if (count(changed)) Graphics3::setTexCoordGeneration(unit, coord, generation);
+}
+
+void RenderStateCache::setTextureMapping(Graphics3::TextureUnit unit, Graphics3::TextureArgument target, bool enabled) {
+	// Only 2D textures are tracked
+	bool changed = unit.unit < 0 || unit.unit >= maxTextureUnits || target != Graphics3::Texture2D || textureUnits[unit.unit].mapping.change(enabled);
+	if (count(changed)) Graphics3::setTextureMapping(unit, target, enabled);
+}
+
+void RenderStateCache::invalidate() {
+	renderStates.clear();
+	materialStates.clear();
+	blendingMode.known = false;
+	fogColor.known = false;
+	projection.known = false;
+	view.known = false;
+	world.known = false;
+	for (int i = 0; i < maxLights; ++i) lights[i].known = false;
+	for (int i = 0; i < maxTextureUnits; ++i) textureUnits[i] = TextureUnitState();
+}
+
+void RenderStateCache::invalidateTextures() {
+	for (int i = 0; i < maxTextureUnits; ++i) {
+		textureUnits[i].texture.known = false;
+		textureUnits[i].mipmapFilter.known = false;
+	}
+}
+
+void RenderStateCache::beginFrame() {
+	issued = 0;
+	elided = 0;
+}
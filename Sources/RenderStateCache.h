@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Kore/Graphics3/Graphics.h>
+#include <vector>
+
+// Shadow copy of the Graphics3 state in front of the driver. Every setter compares with the
+// value set before and only forwards real changes, so a frame can set up everything it needs
+// without paying for the calls that would not change anything. Once the cache is used, the
+// states it covers must not be set on Graphics3 directly or the copy goes stale.
+class RenderStateCache {
+public:
+	RenderStateCache();
+
+	void setRenderState(Kore::Graphics3::RenderState state, bool value);
+	void setRenderState(Kore::Graphics3::RenderState state, int value);
+	void setRenderState(Kore::Graphics3::RenderState state, float value);
+	void setBlendingMode(Kore::Graphics3::BlendingOperation source, Kore::Graphics3::BlendingOperation destination);
+	void setFogColor(Kore::u32 color); // 0xAARRGGBB like Graphics1::Color
+	void setMaterialState(Kore::Graphics3::MaterialState state, const Kore::vec4& value);
+	void setMaterialState(Kore::Graphics3::MaterialState state, float value);
+
+	void setProjectionMatrix(const Kore::mat4& value);
+	void setViewMatrix(const Kore::mat4& value);
+	void setWorldMatrix(const Kore::mat4& value);
+
+	// The light is compared by address, set it again after invalidate() if it was changed
+	void setLight(Kore::Light* light, int num);
+
+	void setTexture(Kore::Graphics3::TextureUnit unit, Kore::Graphics3::Texture* texture);
+	// The filter belongs to the bound texture, it is sent again after a new one was bound
+	void setTextureMipmapFilter(Kore::Graphics3::TextureUnit unit, Kore::Graphics3::MipmapFilter filter);
+	void setTexCoordGeneration(Kore::Graphics3::TextureUnit unit, Kore::Graphics3::TexCoord coord, Kore::Graphics3::TexGen generation);
+	void setTextureMapping(Kore::Graphics3::TextureUnit unit, Kore::Graphics3::TextureArgument target, bool enabled);
+
+	// Forgets everything, the next call of every setter goes to the driver
+	void invalidate();
+	// Forgets the bound textures, needed after textures were deleted as a new one can get the same address
+	void invalidateTextures();
+
+	// Starts counting the calls of a new frame
+	void beginFrame();
+	int issuedCalls() const { return issued; } // forwarded to Graphics3 in this frame
+	int elidedCalls() const { return elided; } // dropped because nothing changed
+
+	static const int maxLights = 8;
+	static const int maxTextureUnits = 8;
+
+private:
+	template<typename T> static bool same(const T& a, const T& b) { return a == b; }
+	static bool same(const Kore::mat4& a, const Kore::mat4& b);
+	static bool same(const Kore::vec4& a, const Kore::vec4& b);
+
+	// A value as the driver has it, unknown until it was set once
+	template<typename T> struct Cached {
+		T value;
+		bool known;
+
+		Cached() : known(false) {}
+
+		// Remembers value and returns whether the driver needs it
+		bool change(const T& newValue) {
+			if (known && same(value, newValue)) return false;
+			value = newValue;
+			known = true;
+			return true;
+		}
+	};
+
+	// Render states are set as bool, int or float, the overload is remembered to compare like with like
+	struct StateValue {
+		int type;
+		int intValue;
+		float floatValue;
+
+		bool operator==(const StateValue& other) const { return type == other.type && intValue == other.intValue && floatValue == other.floatValue; }
+	};
+
+	struct TextureUnitState {
+		Cached<Kore::Graphics3::Texture*> texture;
+		Cached<int> mipmapFilter;
+		Cached<int> coordGeneration[2];
+		Cached<bool> mapping;
+	};
+
+	Cached<StateValue>& renderState(Kore::Graphics3::RenderState state);
+	Cached<Kore::vec4>& materialState(Kore::Graphics3::MaterialState state);
+	bool count(bool changed);
+
+	std::vector<std::pair<Kore::Graphics3::RenderState, Cached<StateValue> > > renderStates;
+	std::vector<std::pair<Kore::Graphics3::MaterialState, Cached<Kore::vec4> > > materialStates;
+	Cached<std::pair<int, int> > blendingMode;
+	Cached<Kore::u32> fogColor;
+	Cached<Kore::mat4> projection;
+	Cached<Kore::mat4> view;
+	Cached<Kore::mat4> world;
+	Cached<Kore::Light*> lights[maxLights];
+	TextureUnitState textureUnits[maxTextureUnits];
+
+	int issued;
+	int elided;
+};
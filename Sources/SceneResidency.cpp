@@ -0,0 +1,122 @@
+#include "pch.h"
+#include "SceneResidency.h"
+#include "MeshBuffer.h"
+#include <Kore/Graphics1/Image.h>
+#include <Kore/Log.h>
+
+using namespace Kore;
+
+namespace {
+	// Including the mipmap chain
+	int textureSize(Graphics3::Texture* texture) {
+		return texture->width * texture->height * Graphics1::Image::sizeOf(texture->format) * 4 / 3;
+	}
+}
+
+SceneResidency::SceneResidency(const SceneAssets* scenes, int numScenes, const Graphics4::VertexStructure& vertexStructure, int budgetBytes)
+	: vertexStructure(vertexStructure), budgetBytes(budgetBytes), frame(0), resident(0), stalls(0), loadCount(0), evictionCount(0) {
+	for (int i = 0; i < numScenes; ++i) {
+		sceneMeshes.push_back(scenes[i].mesh == nullptr ? -1 : findAsset(scenes[i].mesh, false, scenes[i].scale, scenes[i].optimize, scenes[i].tiles));
+		sceneTextures.push_back(scenes[i].texture == nullptr ? -1 : findAsset(scenes[i].texture, true, 1.0f, false, 0));
+	}
+}
+
+SceneResidency::~SceneResidency() {
+	// Loads still in flight are freed by shutdownAssetLoader
+	for (size_t i = 0; i < assets.size(); ++i) {
+		delete assets[i].meshBuffer;
+		delete assets[i].texture;
+	}
+}
+
+int SceneResidency::findAsset(const char* filename, bool isTexture, float scale, bool optimize, int tiles) {
+	for (size_t i = 0; i < assets.size(); ++i) {
+		const Asset& asset = assets[i];
+		if (asset.filename == filename && asset.isTexture == isTexture && asset.scale == scale && asset.optimize == optimize && asset.tiles == tiles) return (int)i;
+	}
+	Asset asset;
+	asset.filename = filename;
+	asset.isTexture = isTexture;
+	asset.scale = scale;
+	asset.optimize = optimize;
+	asset.tiles = tiles;
+	asset.handle = -1;
+	asset.meshBuffer = nullptr;
+	asset.texture = nullptr;
+	asset.bytes = 0;
+	asset.lastRequested = -1;
+	assets.push_back(asset);
+	return (int)assets.size() - 1;
+}
+
+void SceneResidency::requestAsset(int index) {
+	Asset& asset = assets[index];
+	asset.lastRequested = frame;
+	if (isResident(asset) || asset.handle >= 0) return;
+	if (asset.isTexture) asset.handle = loadTextureAsync(asset.filename.c_str());
+	else asset.handle = loadMeshAsync(asset.filename.c_str(), vertexStructure, asset.scale, asset.optimize, asset.tiles);
+	++loadCount;
+}
+
+void SceneResidency::request(int scene) {
+	if (sceneMeshes[scene] >= 0) requestAsset(sceneMeshes[scene]);
+	if (sceneTextures[scene] >= 0) requestAsset(sceneTextures[scene]);
+}
+
+void SceneResidency::takeLoaded(Asset& asset) {
+	if (asset.handle < 0 || !isAssetReady(asset.handle)) return;
+	if (asset.isTexture) {
+		asset.texture = takeLoadedTexture(asset.handle);
+		asset.bytes = textureSize(asset.texture);
+	}
+	else {
+		asset.meshBuffer = takeLoadedMesh(asset.handle);
+		asset.bytes = asset.meshBuffer->sizeInBytes;
+	}
+	asset.handle = -1;
+	resident += asset.bytes;
+}
+
+void SceneResidency::evict(Asset& asset) {
+	delete asset.meshBuffer;
+	delete asset.texture;
+	asset.meshBuffer = nullptr;
+	asset.texture = nullptr;
+	resident -= asset.bytes;
+	asset.bytes = 0;
+	++evictionCount;
+	log(Info, "Evicted %s, %d KB of %d KB resident", asset.filename.c_str(), resident / 1024, budgetBytes / 1024);
+}
+
+void SceneResidency::update(double budgetSeconds) {
+	if (finishAssetUploads(budgetSeconds) > 0) {
+		for (size_t i = 0; i < assets.size(); ++i) takeLoaded(assets[i]);
+	}
+
+	while (resident > budgetBytes) {
+		Asset* oldest = nullptr;
+		for (size_t i = 0; i < assets.size(); ++i) {
+			Asset& asset = assets[i];
+			if (!isResident(asset) || asset.lastRequested == frame) continue;
+			if (oldest == nullptr || asset.lastRequested < oldest->lastRequested) oldest = &asset;
+		}
+		if (oldest == nullptr) break;
+		evict(*oldest);
+	}
+
+	++frame;
+}
+
+MeshBuffer* SceneResidency::mesh(int scene) {
+	if (sceneMeshes[scene] < 0) return nullptr;
+	MeshBuffer* meshBuffer = assets[sceneMeshes[scene]].meshBuffer;
+	if (meshBuffer == nullptr) ++stalls;
+	return meshBuffer;
+}
+
+Graphics3::Texture* SceneResidency::texture(int scene) {
+	if (sceneTextures[scene] < 0) return nullptr;
+	Graphics3::Texture* texture = assets[sceneTextures[scene]].texture;
+	if (texture == nullptr) ++stalls;
+	return texture;
+}
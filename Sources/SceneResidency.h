@@ -0,0 +1,82 @@
+#pragma once
+
+#include "AssetLoader.h"
+#include <string>
+#include <vector>
+
+// What a scene draws
+struct SceneAssets {
+	const char* mesh; // nullptr for none
+	float scale;
+	bool optimize;
+	int tiles; // per side, see MeshTiles.h, 0 draws the mesh whole
+	const char* texture; // nullptr for none
+};
+
+// Loads the assets of a scene in the background when it is first requested and keeps
+// them on the GPU while they fit into the byte budget, evicting the least recently
+// requested ones first. Meshes and textures are tracked one by one, so a texture which
+// two scenes share is only loaded once.
+class SceneResidency {
+public:
+	// scenes and vertexStructure have to outlive the SceneResidency
+	SceneResidency(const SceneAssets* scenes, int numScenes, const Kore::Graphics4::VertexStructure& vertexStructure, int budgetBytes);
+	~SceneResidency();
+
+	// Queues what is missing of the scene and marks its assets as used this frame.
+	// Request the scene that is shown first so its assets are loaded first.
+	void request(int scene);
+
+	// Once per frame: uploads loaded assets within budgetSeconds, then evicts assets
+	// which were not requested this frame until the resident ones fit into the budget
+	void update(double budgetSeconds);
+
+	// nullptr while still loading (which counts as a load stall) or if the scene has none
+	MeshBuffer* mesh(int scene);
+	Kore::Graphics3::Texture* texture(int scene);
+
+	void setBudget(int bytes) { budgetBytes = bytes; }
+	int budget() const { return budgetBytes; }
+
+	// Counters
+	int residentBytes() const { return resident; }
+	int loadStalls() const { return stalls; }
+	int loads() const { return loadCount; }
+	int evictions() const { return evictionCount; }
+
+private:
+	SceneResidency(const SceneResidency&);
+	SceneResidency& operator=(const SceneResidency&);
+
+	struct Asset {
+		std::string filename;
+		bool isTexture;
+		float scale;
+		bool optimize;
+		int tiles;
+
+		AssetHandle handle; // of the pending load, -1 if none
+		MeshBuffer* meshBuffer;
+		Kore::Graphics3::Texture* texture;
+		int bytes;
+		int lastRequested; // frame
+	};
+
+	int findAsset(const char* filename, bool isTexture, float scale, bool optimize, int tiles);
+	void requestAsset(int asset);
+	void takeLoaded(Asset& asset);
+	void evict(Asset& asset);
+	bool isResident(const Asset& asset) const { return asset.meshBuffer != nullptr || asset.texture != nullptr; }
+
+	const Kore::Graphics4::VertexStructure& vertexStructure;
+	std::vector<Asset> assets;
+	std::vector<int> sceneMeshes; // into assets, -1 for none
+	std::vector<int> sceneTextures; // into assets, -1 for none
+
+	int budgetBytes;
+	int frame;
+	int resident;
+	int stalls;
+	int loadCount;
+	int evictionCount;
+};
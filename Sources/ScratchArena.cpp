@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "ScratchArena.h"
+#include <algorithm>
+#include <atomic>
+
+namespace {
+	const size_t alignment = 16;
+
+	// The first block of an arena, later ones are at least as large as all before together
+	const size_t minBlockSize = 64 * 1024;
+
+	std::atomic<size_t> arenaBytes(0);
+	std::atomic<size_t> usedBytes(0);
+	std::atomic<size_t> peakUsedBytes(0);
+
+	void addUsed(size_t bytes) {
+		size_t used = usedBytes += bytes;
+		size_t peak = peakUsedBytes;
+		while (used > peak && !peakUsedBytes.compare_exchange_weak(peak, used)) {}
+	}
+
+	char* allocateBlock(size_t size) {
+		arenaBytes += size;
+		return new char[size];
+	}
+
+	void freeBlock(char* memory, size_t size) {
+		arenaBytes -= size;
+		delete[] memory;
+	}
+}
+
+ScratchArena::ScratchArena() : current(0), offset(0), used(0), totalSize(0) {}
+
+ScratchArena::~ScratchArena() {
+	usedBytes -= used;
+	for (size_t i = 0; i < blocks.size(); ++i) freeBlock(blocks[i].memory, blocks[i].size);
+}
+
+void* ScratchArena::allocateBytes(size_t size) {
+	size = (size + alignment - 1) & ~(alignment - 1);
+	// Blocks left over from a rewind are reused before new ones are added
+	while (current < blocks.size() && offset + size > blocks[current].size) {
+		used += blocks[current].size - offset;
+		addUsed(blocks[current].size - offset);
+		++current;
+		offset = 0;
+	}
+	if (current == blocks.size()) {
+		Block block;
+		block.size = std::max(size, std::max(minBlockSize, totalSize));
+		block.memory = allocateBlock(block.size);
+		blocks.push_back(block);
+		totalSize += block.size;
+	}
+	void* memory = blocks[current].memory + offset;
+	offset += size;
+	used += size;
+	addUsed(size);
+	return memory;
+}
+
+void ScratchArena::rewind(size_t block, size_t blockOffset, size_t blockUsed) {
+	usedBytes -= used - blockUsed;
+	current = block;
+	offset = blockOffset;
+	used = blockUsed;
+}
+
+void ScratchArena::reset() {
+	rewind(0, 0, 0);
+	if (blocks.size() > 1) {
+		for (size_t i = 0; i < blocks.size(); ++i) freeBlock(blocks[i].memory, blocks[i].size);
+		Block block;
+		block.size = totalSize;
+		block.memory = allocateBlock(block.size);
+		blocks.assign(1, block);
+	}
+}
+
+ScratchArena& ScratchArena::local() {
+	thread_local ScratchArena arena;
+	return arena;
+}
+
+ScratchArena::Scope::Scope(ScratchArena& arena) : arena(arena), block(arena.current), offset(arena.offset), used(arena.used) {}
+
+ScratchArena::Scope::~Scope() {
+	if (used == 0) arena.reset();
+	else arena.rewind(block, offset, used);
+}
+
+size_t scratchArenaBytes() {
+	return arenaBytes;
+}
+
+size_t peakScratchArenaBytes() {
+	return peakUsedBytes;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for the temporary arrays of a load. Allocating moves a pointer, freeing happens
+// all at once. The arena keeps its memory afterwards, so once it has grown to the largest load
+// it is used for, loads take their temporaries from it without allocating anything.
+// An arena may be used by any thread, but by one at a time.
+class ScratchArena {
+public:
+	ScratchArena();
+	~ScratchArena();
+
+	// Uninitialized storage for count elements, aligned to 16 bytes, valid until the arena is reset
+	template<typename T> T* allocate(int count) { return static_cast<T*>(allocateBytes(count * sizeof(T))); }
+
+	// Frees everything allocated from the arena. Memory which it had to add since the last reset
+	// is merged into one block, so the next use of the same size does not need to add any.
+	void reset();
+
+	size_t capacity() const { return totalSize; }
+
+	// The calling thread's arena, for temporaries which do not outlive a function
+	static ScratchArena& local();
+
+	// Frees what is allocated from arena within the scope when it ends, so nested users of
+	// local() do not free the allocations of their callers
+	class Scope {
+	public:
+		Scope(ScratchArena& arena);
+		~Scope();
+
+	private:
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+
+		ScratchArena& arena;
+		size_t block;
+		size_t offset;
+		size_t used;
+	};
+
+private:
+	ScratchArena(const ScratchArena&);
+	ScratchArena& operator=(const ScratchArena&);
+
+	struct Block {
+		char* memory;
+		size_t size;
+	};
+
+	void* allocateBytes(size_t size);
+	void rewind(size_t block, size_t offset, size_t used);
+
+	std::vector<Block> blocks;
+	size_t current; // block allocations come from
+	size_t offset; // into the current block
+	size_t used; // including the ends of earlier blocks which were too small for an allocation
+	size_t totalSize;
+};
+
+// Over the arenas of all threads: the memory they keep, and the most of it which was in use at once
+size_t scratchArenaBytes();
+size_t peakScratchArenaBytes();
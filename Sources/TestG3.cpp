@@ -6,6 +6,7 @@
 #endif
 
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 #include <iostream>
 #include <vector>
@@ -17,7 +18,20 @@
 #include <Kore/Graphics3/Graphics.h>
 #include <Kore/Audio/Mixer.h>
 #include <Kore/Log.h>
+#include "AssetLoader.h"
+#include "JobSystem.h"
+#include "LightManager.h"
+#include "MeshBuffer.h"
+#include "MeshCache.h"
 #include "ObjLoader.h"
+#include "ParticleRenderer.h"
+#include "ParticleSystem.h"
+#include "Profiler.h"
+#include "RenderStateCache.h"
+#include "SceneResidency.h"
+#include "ScratchArena.h"
+#include "TextureCache.h"
+#include "Benchmarks.h"
 
 #ifdef VR_RIFT 
 #include "Vr/VrInterface.h"
@@ -35,70 +49,68 @@ using namespace Kore;
 int screenWidth  = 1280;
 int screenHeight = 768;
 
-struct MeshBuffer {
-    MeshBuffer() : vertexBuffer(nullptr), indexBuffer(nullptr) {
-    }
-    ~MeshBuffer() {
-        delete vertexBuffer;
-        delete indexBuffer;
-    }
+Graphics4::VertexStructure vertexStructure;
 
-	Graphics3::VertexBuffer* vertexBuffer;
-	Graphics3::IndexBuffer* indexBuffer;
+// Every light of the scene, the ones lighting the scene mesh are picked each frame (see setupLights)
+LightManager lights;
+Light* selectedLights[RenderStateCache::maxLights];
+
+// Light groups, L switches between them
+const u32 simpleLighting = 1;
+const u32 complexLighting = 2;
+
+ParticleSystem* particles = nullptr;
+ParticleRenderer* particleRenderer = nullptr;
+int numParticles = 30;
+const int minParticles = 30;
+const int maxParticles = 65536;
+
+// Mesh and texture of every scene, the particle scene draws particleQuadMesh instead
+const SceneAssets scenes[] = {
+    { "Text_FixedFunctionOpenGL.obj", 0.4f, true,  0, nullptr },
+    { "UnderTessellatedCube.obj",     0.4f, true,  0, "SeriousGamesTexture.png" },
+    { "TessellatedCube.obj",          0.4f, true,  0, "SeriousGamesTexture.png" },
+    { "TessellatedCube_Bumped2.obj",  0.4f, true,  0, "SphereMap1.jpg" },
+    { "Terrain.obj",                  1.0f, true,  8, "Grass.jpg" },
+    { "TessellatedPlane.obj",         1.0f, true,  0, "Metal.jpg" },
+    { nullptr,                        1.0f, false, 0, "SpriteAlpha.png" },
 };
+const int numScenes = sizeof(scenes) / sizeof(scenes[0]);
 
-static float random(float min, float max) {
-    float r = static_cast<float>(rand()) / RAND_MAX;
-    return min + r * (max - min);
-}
-
-struct Particle {
-    Particle() {
-        reset();
-
-        for (int i = 0, n = rand() % 300; i < n; ++i)
-            simulate(1.0f / 60.0f);
-    }
-
-    void simulate(float dt) {
-        time += dt;
+const char* const particleQuadMesh = "ParticleQuad.obj";
+const float particleQuadScale = 0.25f;
 
-        const vec3 gForce = vec3(0, -9.81f, 0);
+// Assets of the shown scene and its neighbours are kept on the GPU, others while they fit.
+// The largest of these windows, scenes 3 to 5 with three 1024x1024 textures and their mipmaps,
+// takes about 17 MB, so every window fits but not all scenes at once.
+SceneResidency* residency = nullptr;
+const int residencyBudget = 18 * 1024 * 1024;
 
-        const vec3 acceleration = gForce * 0.1f;
+// Level of detail the scene mesh was drawn with last, see selectMeshLod
+int meshLod = 0;
 
-        velocity += acceleration * dt;
+// Tiles of the scene mesh which passed frustum culling this frame, see MeshTiles.h
+std::vector<int> visibleTiles;
 
-        position += velocity * dt;
+// Time spent creating buffers and textures per frame while assets stream in
+const double assetUploadBudget = 0.004;
 
-        if (position.y() < -2.0f) {
-            reset();
-        }
-    }
-
-    float getAlpha() const {
-        return std::min(1.0f, time*2.0f);
-    }
+// All state changes go through the cache, which drops the ones that would not change anything
+RenderStateCache renderStates;
 
-    void reset() {
-        time = 0.0f;
-        position = vec3(0, 0, 0);
-        const float spread = 0.3f;
-        velocity[0] = random(-spread, spread);
-        velocity[1] = 1.3f;
-        velocity[2] = random(-spread, spread);
-    }
-
-    vec3 position;
-    vec3 velocity;
-    float time;
-};
+// Timings of the named job tasks and the state changes, summarized every few seconds
+std::vector<TaskTiming> taskTrace;
+int tracedFrames = 0;
+const int taskTraceFrames = 600;
+int issuedStateChanges = 0;
+int elidedStateChanges = 0;
+int drawnTiles = 0;
+int culledTiles = 0;
+int testedLights = 0;
 
-Graphics4::VertexStructure vertexStructure;
-std::vector<MeshBuffer*> meshBuffers;
-std::vector<Light*> lights;
-std::vector<Graphics3::Texture*> textures;
-std::vector<Particle> particles;
+// Written by the profiler (see Profiler.h) into the working directory
+const char* const profileTraceFile = "profile.json";
+const char* const profileCsvFile = "profile.csv";
 
 // Scene parameters
 std::size_t activeScene             = 0;
@@ -125,115 +137,92 @@ static void debStep(const std::string& s) {
 }
 #endif
 
-MeshBuffer* createMeshBuffer(
-    const Mesh& mesh,
-    const Graphics4::VertexStructure& vertexStructure,
-    float scale = 1.0f)
-{
-    MeshBuffer* meshBuffer = new MeshBuffer();
-
-	meshBuffer->vertexBuffer = new Graphics3::VertexBuffer(mesh.numVertices, vertexStructure, 0);
-	{
-		float* vertices = meshBuffer->vertexBuffer->lock();
-        {
-            float*       dst = vertices;
-            float const* src = mesh.vertices;
-
-			for (int i = 0; i < mesh.numVertices; ++i) {
-                // copy coord
-				dst[0] = src[0] * scale;
-				dst[1] = src[1] * scale;
-				dst[2] = src[2] * scale;
-
-                // copy tex-coord
-				dst[3] = src[3];
-				dst[4] = src[4];
-
-                // copy normal
-				dst[5] = src[5];
-				dst[6] = src[6];
-				dst[7] = src[7];
-
-                dst += 8;
-                src += 8;
-			}
-        }
-		meshBuffer->vertexBuffer->unlock();
-	}
-
-	meshBuffer->indexBuffer = new Graphics3::IndexBuffer(mesh.numFaces * 3);
-	{
-		int* indices = meshBuffer->indexBuffer->lock();
-		for (int i = 0; i < mesh.numFaces * 3; ++i) {
-			indices[i] = mesh.indices[i];
-		}
-		meshBuffer->indexBuffer->unlock();
-	}
-
-    return meshBuffer;
-}
-
+// The level of detail of the last scene says nothing about the next one
 void showNextScene() {
     ++activeScene;
-    if (activeScene >= meshBuffers.size()) {
+    if (activeScene >= numScenes) {
         activeScene = 0;
     }
+    meshLod = 0;
 }
 
 void showPrevScene() {
     if (activeScene == 0) {
-        activeScene = meshBuffers.size() - 1;
+        activeScene = numScenes - 1;
     } else {
         --activeScene;
     }
+    meshLod = 0;
 }
 
-Light* addPointLight(const vec3& position, const vec3& color, float radius = 100.0f) {
-    Light* lit = new Light(PointLight);
-
-    const vec4 ambient(1, 1, 1, 1);
-    const vec4 diffuse(color[0], color[1], color[2], 1);
-    const vec4 specular(1, 1, 1, 1);
-
-    lit->setPosition(position);
-    lit->setAttenuationRadius(radius);
-    lit->setColors(ambient, diffuse, specular);
-
-    lights.push_back(lit);
-
-    return lit;
+// Up and down double and halve the number of particles
+void setParticleCount(int count) {
+    numParticles = std::max(minParticles, std::min(maxParticles, count));
+    if (numParticles == particles->count())
+        return;
+    delete particles;
+    particles = new ParticleSystem(numParticles);
+    Kore::log(Kore::Info, "%d particles", numParticles);
 }
 
-Light* addSpotLight(const vec3& position, const vec3& color, float spotExponent, float spotCutoff, float radius = 100.0f) {
-    Light* lit = new Light(SpotLight);
+void traceFrames() {
+    takeTaskTimings(taskTrace);
+    issuedStateChanges += renderStates.issuedCalls();
+    elidedStateChanges += renderStates.elidedCalls();
+    if (++tracedFrames < taskTraceFrames)
+        return;
+
+    double busy = 0.0;
+    int threads = 0;
+    for (std::size_t i = 0; i < taskTrace.size(); ++i) {
+        busy += taskTrace[i].end - taskTrace[i].start;
+        threads = std::max(threads, taskTrace[i].thread + 1);
+    }
+    Kore::log(Kore::Info, "Tasks: %.1f per frame, %.3f ms busy per frame on up to %d threads",
+        (float)taskTrace.size() / tracedFrames, busy * 1000.0 / tracedFrames, threads);
+    Kore::log(Kore::Info, "State changes: %.1f issued and %.1f elided per frame",
+        (float)issuedStateChanges / tracedFrames, (float)elidedStateChanges / tracedFrames);
+    if (drawnTiles + culledTiles > 0)
+        Kore::log(Kore::Info, "Tiles: %.1f drawn and %.1f culled per frame",
+            (float)drawnTiles / tracedFrames, (float)culledTiles / tracedFrames);
+    Kore::log(Kore::Info, "Lights: %.1f of %d tested per frame",
+        (float)testedLights / tracedFrames, lights.count());
+    Kore::log(Kore::Info, "Loading memory: %.1f KB of meshes (peak %.1f KB), %.1f KB of scratch arenas (peak %.1f KB in use)",
+        meshBytes() / 1024.0, peakMeshBytes() / 1024.0, scratchArenaBytes() / 1024.0, peakScratchArenaBytes() / 1024.0);
+    logProfilerReport();
+    taskTrace.clear();
+    issuedStateChanges = 0;
+    elidedStateChanges = 0;
+    drawnTiles = 0;
+    culledTiles = 0;
+    testedLights = 0;
+    tracedFrames = 0;
+}
 
-    const vec4 ambient(1, 1, 1, 1);
-    const vec4 diffuse(color[0], color[1], color[2], 1);
-    const vec4 specular(1, 1, 1, 1);
+// Keeps the shown scene and the ones before and after it loaded, in that order of priority
+void requestScenes() {
+    residency->request(activeScene);
+    residency->request((activeScene + 1) % numScenes);
+    residency->request((activeScene + numScenes - 1) % numScenes);
+}
 
-    lit->setPosition(position);
-    lit->setAttenuationRadius(radius);
-    lit->setSpot(spotExponent, spotCutoff);
-    lit->setColors(ambient, diffuse, specular);
+// Uploads what the workers finished within the frame's budget and evicts unused scenes
+void updateResidency() {
+    PROFILE_ZONE("Residency update");
 
-    lights.push_back(lit);
+    int loads = residency->loads();
+    int evictions = residency->evictions();
 
-    return lit;
-}
+    requestScenes();
+    residency->update(assetUploadBudget);
 
-Graphics3::Texture* addTexture(const std::string& filename) {
-	Graphics3::Texture* tex = new Graphics3::Texture(filename.c_str());
-    tex->generateMipmaps(0);
-    textures.push_back(tex);
-    return tex;
-}
+    // A texture created later can get the address of an evicted one
+    if (residency->evictions() != evictions)
+        renderStates.invalidateTextures();
 
-MeshBuffer* addMesh(const std::string& filename, float scale = 1.0f) {
-    debStep("Load Mesh \"" + filename + "\"");
-    Mesh* mesh = loadObj(filename.c_str());
-    meshBuffers.push_back(createMeshBuffer(*mesh, vertexStructure, scale));
-    delete mesh;
-    return meshBuffers.back();
+    if (residency->loads() != loads || residency->evictions() != evictions)
+        Kore::log(Kore::Info, "Scene assets: %d KB resident, %d loads, %d evictions, %d load stalls",
+            residency->residentBytes() / 1024, residency->loads(), residency->evictions(), residency->loadStalls());
 }
 
 mat4 rightHandedPerspectiveProjection(float fov, float aspect, float nearPlane, float farPlane) {
@@ -282,15 +271,15 @@ void initScene() {
     updateProjection();
 
     // Initializer render states
-	Graphics3::setRenderState(Graphics3::DepthTest, true);
-    Graphics3::setRenderState(Graphics3::DepthWrite, true);
-	Graphics3::setRenderState(Graphics3::DepthTestCompare, Graphics3::ZCompareLess);
-    Graphics3::setRenderState(Graphics3::Lighting, true);
-    Graphics3::setRenderState(Graphics3::Normalize, true);
+	renderStates.setRenderState(Graphics3::DepthTest, true);
+    renderStates.setRenderState(Graphics3::DepthWrite, true);
+	renderStates.setRenderState(Graphics3::DepthTestCompare, Graphics3::ZCompareLess);
+    renderStates.setRenderState(Graphics3::Lighting, true);
+    renderStates.setRenderState(Graphics3::Normalize, true);
 
     // Initialize material states
-    Graphics3::setMaterialState(Graphics3::SpecularColor, vec4(1, 1, 1, 1));
-    Graphics3::setMaterialState(Graphics3::ShininessExponent, 180.0f);
+    renderStates.setMaterialState(Graphics3::SpecularColor, vec4(1, 1, 1, 1));
+    renderStates.setMaterialState(Graphics3::ShininessExponent, 180.0f);
 
     debStep("Init Render States Done");
 
@@ -299,200 +288,320 @@ void initScene() {
 	vertexStructure.add(Graphics4::VertexTexCoord0, Graphics4::Float2VertexData);
 	vertexStructure.add(Graphics4::VertexNormal, Graphics4::Float3VertexData);
 
-    addMesh("Text_FixedFunctionOpenGL.obj", 0.4f);
-    addMesh("UnderTessellatedCube.obj", 0.4f);
-    addMesh("TessellatedCube.obj", 0.4f);
-    addMesh("TessellatedCube_Bumped2.obj", 0.4f);
-    addMesh("Terrain.obj", 1.0f);
-    addMesh("TessellatedPlane.obj", 1.0f);
-    addMesh("ParticleQuad.obj", 0.25f);
+    // Meshes and textures load in the background when their scene comes up
+    startJobs();
+    residency = new SceneResidency(scenes, numScenes, vertexStructure, residencyBudget);
+    requestScenes();
 
     // Create light source
-    addPointLight(vec3(0, 0, 1.7f), vec3(1, 1, 1));
+    lights.addPointLight(vec3(0, 0, 1.7f), vec3(1, 1, 1), 100.0f, simpleLighting);
 
     const float spotLightDist = 0.35f;
-    addSpotLight(vec3(0, spotLightDist, 1), vec3(1, 0.2f, 0.2f), 128.0f, 15.0f);//->setDirection(vec3(0, -0.2f, 1).normalize());
-    addSpotLight(vec3(-spotLightDist, -spotLightDist, 1), vec3(0.2f, 1, 0.2f), 90, 25.0f);
-    addSpotLight(vec3(spotLightDist, -spotLightDist, 1), vec3(0.2f, 0.02f, 1), 35.0f, 35.0f);
-
-    // Load textures
-    addTexture("SeriousGamesTexture.png");
-    addTexture("SphereMap1.jpg");
-    addTexture("Grass.jpg");
-    addTexture("Metal.jpg");
-    addTexture("SpriteAlpha.png");
+    lights.addSpotLight(vec3(0, spotLightDist, 1), vec3(1, 0.2f, 0.2f), 128.0f, 15.0f, 100.0f, complexLighting);//->setDirection(vec3(0, -0.2f, 1).normalize());
+    lights.addSpotLight(vec3(-spotLightDist, -spotLightDist, 1), vec3(0.2f, 1, 0.2f), 90, 25.0f, 100.0f, complexLighting);
+    lights.addSpotLight(vec3(spotLightDist, -spotLightDist, 1), vec3(0.2f, 0.02f, 1), 35.0f, 35.0f, 100.0f, complexLighting);
 
-    debStep("Loading Textures Done");
+    debStep("Loading Started");
 
     // Add particles
-    particles.resize(30);
+    particles = new ParticleSystem(numParticles);
+
+    // The particles are batched copies of the quad, see ParticleRenderer
+    Mesh particleQuad = loadObj(particleQuadMesh, particleQuadScale);
+    particleRenderer = new ParticleRenderer(particleQuad);
+}
+
+// Writes a .kmesh next to every scene mesh, run with "--bake-meshes" from the Deployment directory
+// (like "--bench-numbers", see Benchmarks.h)
+int bakeSceneMeshes() {
+    int failed = 0;
+    for (int i = 0; i < numScenes; ++i) {
+        if (scenes[i].mesh == nullptr)
+            continue;
+        std::string target = bakedMeshFilename(scenes[i].mesh);
+        if (bakeMesh(scenes[i].mesh, target.c_str(), scenes[i].scale, scenes[i].optimize, true, maxMeshLods)) {
+            Kore::log(Kore::Info, "Baked %s", target.c_str());
+            BakedMesh baked(target.c_str(), scenes[i].mesh, scenes[i].scale, scenes[i].optimize);
+            if (baked.valid()) {
+                const int packed = packedMeshSize(baked.numVertices(), baked.numIndices());
+                const int unpacked = unpackedMeshSize(baked.numVertices(), baked.numIndices());
+                Kore::log(Kore::Info, "Packed %s takes %d instead of %d bytes (saves %d bytes)", scenes[i].mesh, packed, unpacked, unpacked - packed);
+            }
+        } else {
+            Kore::log(Kore::Error, "Could not bake %s", target.c_str());
+            ++failed;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+// Writes a .ktex next to every scene texture, run with "--bake-textures" from the Deployment directory
+int bakeSceneTextures() {
+    int failed = 0;
+    for (int i = 0; i < numScenes; ++i) {
+        if (scenes[i].texture == nullptr)
+            continue;
+        std::string target = bakedTextureFilename(scenes[i].texture);
+        if (bakeTexture(scenes[i].texture, target.c_str())) {
+            Kore::log(Kore::Info, "Baked %s", target.c_str());
+        } else {
+            Kore::log(Kore::Error, "Could not bake %s", target.c_str());
+            ++failed;
+        }
+    }
+    return failed == 0 ? 0 : 1;
 }
 
 void releaseScene() {
-    for (std::vector<MeshBuffer*>::iterator it = meshBuffers.begin(); it != meshBuffers.end(); ++it)
-        delete (*it);
-    meshBuffers.clear();
+    stopJobs();
+    delete residency;
+    residency = nullptr;
+    delete particles;
+    particles = nullptr;
+    delete particleRenderer;
+    particleRenderer = nullptr;
+    shutdownAssetLoader();
 
-    for (std::vector<Light*>::iterator it = lights.begin(); it != lights.end(); ++it)
-        delete (*it);
     lights.clear();
+}
 
-    for (std::vector<Graphics3::Texture*>::iterator it = textures.begin(); it != textures.end(); ++it)
-        delete (*it);
-    textures.clear();
+// Space writes the zones since the last report for chrome://tracing and their percentiles
+void writeProfile() {
+    if (writeProfilerTrace(profileTraceFile) && writeProfilerCsv(profileCsvFile))
+        Kore::log(Kore::Info, "Wrote %s and %s", profileTraceFile, profileCsvFile);
+    else
+        Kore::log(Kore::Error, "Could not write the profile, was it built with TESTG3_PROFILE=1 (see korefile.js)?");
 }
 
-void onDrawFrame() {
-	Audio::update();
-		
-	Graphics3::begin();
-	Graphics3::clear(Graphics3::ClearColorFlag | Graphics3::ClearDepthFlag, 0xff808080);
-		
-    static float angle;
-    if(rotationEnabled) angle += 0.5f;
-	wMatrix = mat4::RotationY(DEG_2_RAD(std::sin(DEG_2_RAD(angle*1.5f))*75.0f));
-    //wMatrix = mat4::RotationY(DEG_2_RAD(angle));
+// Lights are positioned with identity view and world matrices, so they are in view space like
+// the bounding sphere of the mesh they are picked for
+void setupLights(const MeshBuffer& meshBuf) {
+    PROFILE_ZONE("Light setup");
 
-    // Initailize face culling
-    //Graphics3::setRenderState(BackfaceCulling, Clockwise); // for right-handed coordinate systems
-    Graphics3::setRenderState(Graphics3::BackfaceCulling, Graphics3::CounterClockwise);
+    renderStates.setViewMatrix(mat4::Identity());
+    renderStates.setWorldMatrix(mat4::Identity());
 
-    // Setup projection
-    Graphics3::setProjectionMatrix(pMatrix);
+    float center[3];
+    viewSpaceCenter(meshBuf, vMatrix.Invert() * wMatrix, center);
 
-    // Setup lights
-    Graphics3::setViewMatrix(mat4::Identity());
-    Graphics3::setWorldMatrix(mat4::Identity());
+    const int count = lights.select(vec3(center[0], center[1], center[2]), meshBuf.radius, complexLightingEnabled ? complexLighting : simpleLighting,
+        selectedLights, RenderStateCache::maxLights);
+    testedLights += lights.testedLights();
 
     int lightID = 0;
-    for (std::size_t i = 0, n = lights.size(); (lightID < 8 && i < n); ++i) {
-        Light* lit = lights[i];
-        if ( ( complexLightingEnabled && i > 0 ) ||
-                ( !complexLightingEnabled && i == 0 ) )
-        {
-            Graphics3::setLight(lights[i], lightID++);
-        }
+    for (; lightID < count; ++lightID) {
+        renderStates.setLight(selectedLights[lightID], lightID);
     }
-		
-    for (; lightID < 8; ++lightID) {
-        Graphics3::setLight(nullptr, lightID);
+    for (; lightID < RenderStateCache::maxLights; ++lightID) {
+        renderStates.setLight(nullptr, lightID);
     }
-		
-    // Setup texture mapping
+}
+
+// Scenes are drawn untextured while their texture is loading
+void setupTexture() {
+    PROFILE_ZONE("Texture setup");
+
 	Graphics3::TextureUnit texUnit0;
     texUnit0.unit = 0;
 
     if (textureMappingEnabled)
     {
-        Graphics3::setTextureMipmapFilter(texUnit0, Graphics3::LinearMipFilter);
+        // Only asked for when it is bound, a missing one counts as a load stall
+        Graphics3::Texture* texture = residency->texture(activeScene);
 
-        if (activeScene >= 1 && activeScene <= 2)
+        if (activeScene >= 1 && activeScene <= 2 && texture != nullptr)
         {
-            Graphics3::setTexture(texUnit0, textures[0]);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenDisabled);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenDisabled);
-            Graphics3::setTextureMapping(texUnit0, Graphics3::Texture2D, true);
+            renderStates.setTexture(texUnit0, texture);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenDisabled);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenDisabled);
+            renderStates.setTextureMapping(texUnit0, Graphics3::Texture2D, true);
         }
-        else if (activeScene == 3)
+        else if (activeScene == 3 && texture != nullptr)
         {
-            Graphics3::setTexture(texUnit0, textures[1]);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenSphereMap);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenSphereMap);
-            Graphics3::setTextureMapping(texUnit0, Graphics3::Texture2D, true);
+            renderStates.setTexture(texUnit0, texture);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenSphereMap);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenSphereMap);
+            renderStates.setTextureMapping(texUnit0, Graphics3::Texture2D, true);
         }
-        else if (activeScene == 4)
+        else if (activeScene == 4 && texture != nullptr)
         {
-            Graphics3::setTexture(texUnit0, textures[2]);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenDisabled);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenDisabled);
-            Graphics3::setTextureMapping(texUnit0, Graphics3::Texture2D, true);
+            renderStates.setTexture(texUnit0, texture);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenDisabled);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenDisabled);
+            renderStates.setTextureMapping(texUnit0, Graphics3::Texture2D, true);
         }
-        else if (activeScene == 5)
+        else if (activeScene == 5 && texture != nullptr)
         {
-            Graphics3::setTexture(texUnit0, textures[3]);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenDisabled);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenDisabled);
-            Graphics3::setTextureMapping(texUnit0, Graphics3::Texture2D, true);
+            renderStates.setTexture(texUnit0, texture);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenDisabled);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenDisabled);
+            renderStates.setTextureMapping(texUnit0, Graphics3::Texture2D, true);
         }
-        else if (activeScene == 6)
+        else if (activeScene == 6 && texture != nullptr)
         {
-            Graphics3::setTexture(texUnit0, textures[4]);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenDisabled);
-            Graphics3::setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenDisabled);
-            Graphics3::setTextureMapping(texUnit0, Graphics3::Texture2D, true);
+            renderStates.setTexture(texUnit0, texture);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordX, Graphics3::TexGenDisabled);
+            renderStates.setTexCoordGeneration(texUnit0, Graphics3::TexCoordY, Graphics3::TexGenDisabled);
+            renderStates.setTextureMapping(texUnit0, Graphics3::Texture2D, true);
         }
         else
-            Graphics3::setTextureMapping(texUnit0, Graphics3::Texture2D, false);
+            renderStates.setTextureMapping(texUnit0, Graphics3::Texture2D, false);
+
+        // After binding, the filter is a setting of the texture
+        renderStates.setTextureMipmapFilter(texUnit0, Graphics3::LinearMipFilter);
     }
     else
-        Graphics3::setTextureMapping(texUnit0, Graphics3::Texture2D, false);
+        renderStates.setTextureMapping(texUnit0, Graphics3::Texture2D, false);
+}
+
+// Fog distances animate over time
+void setupFog() {
+    PROFILE_ZONE("Fog setup");
 
-	// Setup Fog
 	static float fogInterval;
 	fogInterval += 1.0f;
-	Graphics3::setRenderState(Graphics3::FogStart, 1.0f);
-	Graphics3::setRenderState(Graphics3::FogEnd, ((Kore::cos(DEG_2_RAD(fogInterval)) + 1.0f) * 2.5f) + 2.0f);
-	Graphics3::setRenderState(Graphics3::FogDensity, (Kore::cos(DEG_2_RAD(fogInterval * 0.5f)) + 1.0f) * 0.5f);
+	renderStates.setRenderState(Graphics3::FogStart, 1.0f);
+	renderStates.setRenderState(Graphics3::FogEnd, ((Kore::cos(DEG_2_RAD(fogInterval)) + 1.0f) * 2.5f) + 2.0f);
+	renderStates.setRenderState(Graphics3::FogDensity, (Kore::cos(DEG_2_RAD(fogInterval * 0.5f)) + 1.0f) * 0.5f);
 
-	Graphics3::setFogColor(Graphics1::Color(0xff808080));
-	Graphics3::setRenderState(Graphics3::FogType, activeFogType);
-	Graphics3::setRenderState(Graphics3::FogState, fogEnabled);
+	renderStates.setFogColor(0xff808080);
+	renderStates.setRenderState(Graphics3::FogType, activeFogType);
+	renderStates.setRenderState(Graphics3::FogState, fogEnabled);
+}
 
-    // Setup scene greometry
-    MeshBuffer* meshBuf = meshBuffers[activeScene];
-	Graphics3::setIndexBuffer(*meshBuf->indexBuffer);
-	Graphics3::setVertexBuffer(*meshBuf->vertexBuffer);
+// Draws the tiles in view with one call per run of neighbouring ones, or the whole mesh if it has no tiles
+void drawSceneMesh(const MeshBuffer& meshBuf) {
+    if (meshBuf.tiles == nullptr || meshLod != 0)
+    {
+        Graphics3::drawIndexedVertices();
+        return;
+    }
+
+    const MeshTiles& tiles = *meshBuf.tiles;
+    int count;
+    {
+        PROFILE_ZONE("Tile culling");
+        visibleTiles.resize(tiles.count());
+        count = tiles.cull(pMatrix * vMatrix.Invert() * wMatrix, visibleTiles.data());
+    }
+    drawnTiles += count;
+    culledTiles += tiles.count() - count;
+
+    for (int i = 0; i < count;)
+    {
+        const int start = tiles.start(visibleTiles[i]);
+        int end = start + tiles.indexCount(visibleTiles[i]);
+        for (++i; i < count && tiles.start(visibleTiles[i]) == end; ++i)
+            end += tiles.indexCount(visibleTiles[i]);
+        if (end > start)
+            Graphics3::drawIndexedVertices(start, end - start);
+    }
+}
+
+void finishFrame() {
+	Graphics3::end();
+	Graphics3::swapBuffers();
+
+    traceFrames();
+    endProfilerFrame();
+}
+
+void onDrawFrame() {
+    {
+        PROFILE_ZONE("Audio update");
+        Audio::update();
+    }
+
+    // Real time since the last frame, at most a second
+    static double lastFrame = System::time();
+    const double now = System::time();
+    const float frameTime = static_cast<float>(std::min(now - lastFrame, 1.0));
+    lastFrame = now;
+
+    renderStates.beginFrame();
+    updateResidency();
+		
+	Graphics3::begin();
+	Graphics3::clear(Graphics3::ClearColorFlag | Graphics3::ClearDepthFlag, 0xff808080);
+		
+    static float angle;
+    if(rotationEnabled) angle += 0.5f;
+	wMatrix = mat4::RotationY(DEG_2_RAD(std::sin(DEG_2_RAD(angle*1.5f))*75.0f));
+    //wMatrix = mat4::RotationY(DEG_2_RAD(angle));
+
+    // Initailize face culling
+    //renderStates.setRenderState(BackfaceCulling, Clockwise); // for right-handed coordinate systems
+    renderStates.setRenderState(Graphics3::BackfaceCulling, Graphics3::CounterClockwise);
+
+    // Setup projection
+    renderStates.setProjectionMatrix(pMatrix);
+
+    setupTexture();
+    setupFog();
 
     if (activeScene == 6)
     {
         // Set material states for particles
-	    Graphics3::setRenderState(Graphics3::DepthTest, false);
-        Graphics3::setRenderState(Graphics3::DepthWrite, false);
-        Graphics3::setRenderState(Graphics3::Lighting, false);
-        Graphics3::setRenderState(Graphics3::BlendingState, true);
-        Graphics3::setBlendingMode(Graphics3::SourceAlpha, Graphics3::InverseSourceAlpha);
+	    renderStates.setRenderState(Graphics3::DepthTest, false);
+        renderStates.setRenderState(Graphics3::DepthWrite, false);
+        renderStates.setRenderState(Graphics3::Lighting, false);
+        renderStates.setRenderState(Graphics3::BlendingState, true);
+        renderStates.setBlendingMode(Graphics3::SourceAlpha, Graphics3::InverseSourceAlpha);
 
         // Setup view matrix
-        Graphics3::setViewMatrix(vMatrix.Invert());
-
-        // Set world matrix to view rotation
-        mat4 wMatrixParticle = vMatrix;
+        renderStates.setViewMatrix(vMatrix.Invert());
 
-        const float deltaTime = 1.0f/60.0f;
-
-        for (std::vector<Particle>::iterator it = particles.begin(); it != particles.end(); ++it)
         {
-            it->simulate(deltaTime);
+            PROFILE_ZONE("Particle simulation");
+            particles->update(frameTime);
+        }
 
-            // Locate world matrix to particle position
-            for (int i = 0; i < 3; ++i)
-                wMatrixParticle.Set(i, 3, it->position[i]);
+        // Draw all particle quads at once, turned like the view, with their alpha in the vertex colors.
+        // The renderer binds its own buffers, so the scene has no mesh to wait for.
+        renderStates.setWorldMatrix(mat4::Identity());
+        renderStates.setMaterialState(Graphics3::SolidColor, vec4(1.0f, 1.0f, 1.0f, 1.0f));
+        {
+            PROFILE_ZONE("Draw submission");
+            particleRenderer->draw(*particles, vMatrix);
+        }
 
-            Graphics3::setWorldMatrix(wMatrixParticle);
-            Graphics3::setMaterialState(Graphics3::SolidColor, vec4(1.0f, 1.0f, 1.0f, it->getAlpha()));
+        finishFrame();
+        return;
+    }
 
-            // Draw particle quads
-	        Graphics3::drawIndexedVertices();
-        }
+    // Setup scene greometry, nothing to draw while it is still loading
+    MeshBuffer* meshBuf = residency->mesh(activeScene);
+    if (meshBuf == nullptr)
+    {
+        finishFrame();
+        return;
     }
-    else
+
+    setupLights(*meshBuf);
+
+	// Distant or small meshes are drawn with fewer triangles
+	meshLod = selectMeshLod(*meshBuf, pMatrix, vMatrix.Invert() * wMatrix, screenHeight, std::min(meshLod, meshBuf->levels() - 1));
+
+	Graphics3::setIndexBuffer(*meshBuf->levelIndexBuffer(meshLod));
+	Graphics3::setVertexBuffer(*meshBuf->vertexBuffer);
+
+    // Set material states for standard geometry
+    renderStates.setRenderState(Graphics3::DepthTest, true);
+    renderStates.setRenderState(Graphics3::DepthWrite, true);
+    renderStates.setRenderState(Graphics3::Lighting, true);
+    renderStates.setRenderState(Graphics3::BlendingState, false);
+
+    // Setup view- and world matrices
+    renderStates.setViewMatrix(vMatrix.Invert());
+    renderStates.setWorldMatrix(wMatrix);
+
+    // Draw geometry
     {
-        // Set material states for standard geometry
-	    Graphics3::setRenderState(Graphics3::DepthTest, true);
-        Graphics3::setRenderState(Graphics3::DepthWrite, true);
-        Graphics3::setRenderState(Graphics3::Lighting, true);
-        Graphics3::setRenderState(Graphics3::BlendingState, false);
-
-        // Setup view- and world matrices
-        Graphics3::setViewMatrix(vMatrix.Invert());
-        Graphics3::setWorldMatrix(wMatrix);
-
-        // Draw geometry
-	    Graphics3::drawIndexedVertices();
+        PROFILE_ZONE("Draw submission");
+        drawSceneMesh(*meshBuf);
     }
 
-	Graphics3::end();
-	Graphics3::swapBuffers();
+    finishFrame();
 }
 
 void onKeyEvent(KeyCode code, bool down) {
@@ -546,6 +655,18 @@ void keyDown(KeyCode code, wchar_t character)
         case Key_T:
             textureMappingEnabled = !textureMappingEnabled;
             break;
+
+        case Key_Up:
+            setParticleCount(numParticles * 2);
+            break;
+
+        case Key_Down:
+            setParticleCount(numParticles / 2);
+            break;
+
+        case Key_Space:
+            writeProfile();
+            break;
     }
 
     onKeyEvent(code, true);
@@ -582,6 +703,19 @@ extern "C"
 #endif
 int kore(int argc, char** argv)
 {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--bake-meshes") == 0)
+            return bakeSceneMeshes();
+        if (strcmp(argv[i], "--bake-textures") == 0)
+            return bakeSceneTextures();
+        if (strcmp(argv[i], "--bench-numbers") == 0)
+            return benchmarkNumberParsing();
+        if (strcmp(argv[i], "--bench-particles") == 0)
+            return benchmarkParticles();
+        if (strcmp(argv[i], "--bench-sort") == 0)
+            return benchmarkParticleSorting();
+    }
+
     //Kore::Graphics3::setAntialiasingSamples(8);
     Kore::System::init("Test Environment", screenWidth, screenHeight);
 
@@ -0,0 +1,154 @@
+#include "pch.h"
+#include "TextureCache.h"
+#include "MipChain.h"
+#include <Kore/Graphics1/Image.h>
+#include <Kore/Log.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace Kore;
+
+namespace {
+	const char magic[4] = { 'K', 'T', 'E', 'X' };
+
+	int bakedTextureSize(int width, int height, int levels) {
+		int size = (int)sizeof(BakedTextureHeader);
+		for (int level = 0; level < levels; ++level) size += mipLevelSize(width, level) * mipLevelSize(height, level) * 4;
+		return size;
+	}
+
+	bool sourceMatches(const BakedTextureHeader& header, const char* imageFilename) {
+		FileStamp stamp;
+		if (fileStamp(imageFilename, stamp)) return header.sourceSize == stamp.size && header.sourceModified != 0 && header.sourceModified == stamp.modified;
+
+		MappedFile source(imageFilename);
+		return source.data() != nullptr && header.sourceSize == (u32)source.size() && header.sourceHash == hashBytes(source.data(), source.size());
+	}
+
+	float toLinear(u8 value) {
+		float c = value / 255.0f;
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	u8 toSrgb(float value) {
+		float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+		return (u8)std::min(255.0f, std::max(0.0f, c * 255.0f + 0.5f));
+	}
+
+	// Next level from 2x2 texels of source, texels past an odd edge are clamped. The colors are
+	// averaged in linear space, each weighted by its alpha so transparent texels do not tint the result.
+	void filterLevel(const u8* source, int sourceWidth, int sourceHeight, u8* target, int width, int height, const float* linear) {
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				float color[3] = { 0, 0, 0 };
+				float unweighted[3] = { 0, 0, 0 };
+				float alpha = 0;
+				for (int dy = 0; dy < 2; ++dy) {
+					for (int dx = 0; dx < 2; ++dx) {
+						int sx = std::min(x * 2 + dx, sourceWidth - 1);
+						int sy = std::min(y * 2 + dy, sourceHeight - 1);
+						const u8* texel = &source[(sy * sourceWidth + sx) * 4];
+						float weight = texel[3] / 255.0f;
+						for (int channel = 0; channel < 3; ++channel) {
+							color[channel] += linear[texel[channel]] * weight;
+							unweighted[channel] += linear[texel[channel]];
+						}
+						alpha += weight;
+					}
+				}
+				u8* result = &target[(y * width + x) * 4];
+				for (int channel = 0; channel < 3; ++channel) {
+					result[channel] = toSrgb(alpha > 0.0f ? color[channel] / alpha : unweighted[channel] * 0.25f);
+				}
+				result[3] = (u8)(alpha * 0.25f * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+BakedTexture::BakedTexture(const char* ktexFilename, const char* imageFilename) : file(ktexFilename), header(nullptr) {
+	if (file.data() == nullptr || file.size() < (int)sizeof(BakedTextureHeader)) return;
+
+	const BakedTextureHeader* candidate = reinterpret_cast<const BakedTextureHeader*>(file.data());
+	if (memcmp(candidate->magic, magic, 4) != 0 || candidate->version != bakedTextureVersion) return;
+	if (candidate->width <= 0 || candidate->height <= 0 || candidate->levels != mipLevelCount(candidate->width, candidate->height)) return;
+	if (candidate->levels > maxMipLevels) return;
+
+	if (file.size() != bakedTextureSize(candidate->width, candidate->height, candidate->levels)) return;
+
+	if (!sourceMatches(*candidate, imageFilename)) return;
+
+	header = candidate;
+}
+
+int BakedTexture::width(int level) const {
+	return mipLevelSize(header->width, level);
+}
+
+int BakedTexture::height(int level) const {
+	return mipLevelSize(header->height, level);
+}
+
+const u8* BakedTexture::levelData(int level) const {
+	const char* data = file.data() + sizeof(BakedTextureHeader);
+	for (int i = 0; i < level; ++i) data += width(i) * height(i) * 4;
+	return reinterpret_cast<const u8*>(data);
+}
+
+bool bakeTexture(const char* imageFilename, const char* ktexFilename) {
+	MappedFile source(imageFilename);
+	if (source.data() == nullptr) return false;
+
+	Graphics1::Image image(imageFilename, true);
+	if (image.format != Graphics1::Image::RGBA32 || image.width <= 0 || image.height <= 0) {
+		Kore::log(Kore::Warning, "%s is not RGBA32, it is not baked", imageFilename);
+		return false;
+	}
+
+	BakedTextureHeader header;
+	memcpy(header.magic, magic, 4);
+	header.version = bakedTextureVersion;
+	header.sourceSize = (u32)source.size();
+	header.sourceHash = hashBytes(source.data(), source.size());
+	FileStamp stamp;
+	header.sourceModified = fileStamp(imageFilename, stamp) ? stamp.modified : 0;
+	header.width = image.width;
+	header.height = image.height;
+	header.levels = mipLevelCount(image.width, image.height);
+	header.padding = 0;
+	if (header.levels > maxMipLevels) return false;
+
+	float linear[256];
+	for (int i = 0; i < 256; ++i) linear[i] = toLinear((u8)i);
+
+	// Written with stdio instead of FileWriter, which targets the save directory rather than the assets
+	FILE* file = fopen(ktexFilename, "wb");
+	bool success = file != nullptr;
+	if (success) {
+		success = fwrite(&header, sizeof(header), 1, file) == 1;
+		std::vector<u8> level(image.data, image.data + image.width * image.height * 4);
+		std::vector<u8> next;
+		for (int i = 0; i < header.levels && success; ++i) {
+			int width = mipLevelSize(image.width, i);
+			int height = mipLevelSize(image.height, i);
+			if (i > 0) {
+				next.resize(width * height * 4);
+				filterLevel(level.data(), mipLevelSize(image.width, i - 1), mipLevelSize(image.height, i - 1), next.data(), width, height, linear);
+				level.swap(next);
+			}
+			success = fwrite(level.data(), 4, width * height, file) == (size_t)(width * height);
+		}
+		success = fclose(file) == 0 && success;
+		if (!success) remove(ktexFilename);
+	}
+
+	return success;
+}
+
+std::string bakedTextureFilename(const std::string& imageFilename) {
+	std::string::size_type dot = imageFilename.find_last_of('.');
+	return (dot == std::string::npos ? imageFilename : imageFilename.substr(0, dot)) + ".ktex";
+}
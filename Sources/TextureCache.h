@@ -0,0 +1,48 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <string>
+
+// Baked textures (.ktex) hold the whole mip chain of an image, level 0 first, every level
+// RGBA32 with tightly packed rows. The smaller levels are filtered offline in linear space
+// and weighted by alpha, which keeps them from darkening and transparent texels from bleeding
+// into their neighbours, so loading is mapping the file and uploading the levels. The header
+// remembers the image it was baked from so a stale file is ignored and the image is decoded
+// again, like BakedMeshHeader it is compared by FileStamp.
+struct BakedTextureHeader {
+	char magic[4];
+	Kore::u32 version;
+	Kore::u32 sourceSize;
+	Kore::u32 sourceHash;
+	Kore::s32 width;
+	Kore::s32 height;
+	Kore::s32 levels;
+	Kore::u32 padding;
+	Kore::u64 sourceModified; // FileStamp::modified, 0 if there was none
+};
+
+const int bakedTextureVersion = 2;
+
+class BakedTexture {
+public:
+	// Maps ktexFilename, valid() is false if it is missing, corrupt or does not match imageFilename
+	BakedTexture(const char* ktexFilename, const char* imageFilename);
+
+	bool valid() const { return header != nullptr; }
+	int levels() const { return header->levels; }
+	int width(int level) const;
+	int height(int level) const;
+
+	// width(level) * height(level) RGBA32 texels
+	const Kore::u8* levelData(int level) const;
+
+private:
+	MappedFile file;
+	const BakedTextureHeader* header;
+};
+
+// Offline step: decodes imageFilename, filters its mip chain and writes ktexFilename
+bool bakeTexture(const char* imageFilename, const char* ktexFilename);
+
+// "Grass.jpg" -> "Grass.ktex"
+std::string bakedTextureFilename(const std::string& imageFilename);
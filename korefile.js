@@ -4,6 +4,12 @@ project.addFile('Sources/**');
 project.setDebugDir('Deployment');
 project.cpp11 = true;
 
+// Frame profiler zones, see Sources/Profiler.h. Without the define they compile to nothing, so
+// they are only built in for development: TESTG3_PROFILE=1 node Kore/make
+if (process.env.TESTG3_PROFILE === '1') {
+	project.addDefine('ENABLE_PROFILER');
+}
+
 Project.createProject('Kore', __dirname).then((subproject) => {
 	project.addSubProject(subproject);
 	resolve(project);